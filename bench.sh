@@ -0,0 +1,8 @@
+#/usr/bin/sh
+
+gcc ./src/bench.c ./src/draw.c ./src/sim.c ./src/batch.c ./src/soa.c \
+./src/ai.c ./src/policy.c ./src/vec_env.c ./src/snapshot.c ./src/multiball.c \
+./src/profile.c ./src/pacing.c \
+-O3 -march=native -ffp-contract=off -Wall -Wswitch-enum -Wextra \
+-lraylib -ldl \
+-o bench && ./bench "$@"
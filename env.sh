@@ -0,0 +1,7 @@
+#/usr/bin/sh
+
+gcc -shared -fPIC ./src/vec_env.c ./src/sim.c ./src/ai.c ./src/policy.c \
+./src/profile.c \
+-O3 -march=native -ffp-contract=off -Wall -Wswitch-enum -Wextra \
+-lm -ldl \
+-o libpong_env.so
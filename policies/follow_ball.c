@@ -0,0 +1,177 @@
+// Example policy for policy_abi.h: moves the paddle towards the ball.
+//
+// As a shared library:
+//   gcc -O2 -shared -fPIC -Isrc policies/follow_ball.c -o follow_ball.so
+//   ./pong --batch 1000 --policy "so:./follow_ball.so"
+// As a process talking over stdin/stdout:
+//   gcc -O2 -DPOLICY_MAIN -Isrc policies/follow_ball.c -o follow_ball
+//   ./pong --batch 1000 --policy "exec:./follow_ball"
+// Over a Unix socket, serve one connection at a time on PATH:
+//   ./follow_ball PATH &
+//   ./pong --batch 1000 --threads 1 --policy "unix:PATH"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "policy_abi.h"
+
+typedef struct {
+  float dead_zone; // fraction of the paddle height
+} Follow_Ball;
+
+static void *follow_create(const char *args) {
+  Follow_Ball *f = malloc(sizeof(Follow_Ball));
+  f->dead_zone = args && *args ? strtof(args, NULL) : 0.25f;
+  return f;
+}
+
+static void follow_step(void *policy, const Pong_Observation *obs,
+                        uint8_t *actions, uint32_t count) {
+  Follow_Ball *f = policy;
+  for (uint32_t i = 0; i < count; i++) {
+    const Pong_Observation *o = &obs[i];
+    float diff = o->ball_y - (o->paddle_y + o->paddle_h / 2);
+    if (diff < -f->dead_zone * o->paddle_h)
+      actions[i] = Pong_Action_Up;
+    else if (diff > f->dead_zone * o->paddle_h)
+      actions[i] = Pong_Action_Down;
+    else
+      actions[i] = Pong_Action_None;
+  }
+}
+
+static void follow_destroy(void *policy) { free(policy); }
+
+static const Pong_Policy_Api follow_api = {
+    .abi_version = PONG_POLICY_ABI_VERSION,
+    .create = follow_create,
+    .step = follow_step,
+    .destroy = follow_destroy,
+};
+
+const Pong_Policy_Api *pong_policy_api(void) { return &follow_api; }
+
+#ifdef POLICY_MAIN
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int read_full(int fd, void *buf, size_t n) {
+  uint8_t *p = buf;
+  while (n > 0) {
+    ssize_t r = read(fd, p, n);
+    if (r <= 0)
+      return 0;
+    p += r;
+    n -= r;
+  }
+  return 1;
+}
+
+static int write_full(int fd, const void *buf, size_t n) {
+  const uint8_t *p = buf;
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w <= 0)
+      return 0;
+    p += w;
+    n -= w;
+  }
+  return 1;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static float get_lef32(const uint8_t *p) {
+  uint32_t v = get_le32(p);
+  float f;
+  memcpy(&f, &v, sizeof(f));
+  return f;
+}
+
+// Serves one connection until the host hangs up.
+static void serve(void *policy, int in, int out) {
+  uint8_t hello[8];
+  if (!read_full(in, hello, sizeof(hello)) || memcmp(hello, "PONGPOL", 7))
+    return;
+  uint8_t version = PONG_POLICY_ABI_VERSION;
+  if (!write_full(out, &version, 1))
+    return;
+
+  Pong_Observation *obs = NULL;
+  uint8_t *wire = NULL, *actions = NULL;
+  uint32_t cap = 0;
+  for (;;) {
+    uint8_t header[4];
+    if (!read_full(in, header, sizeof(header)))
+      break;
+    uint32_t count = get_le32(header);
+    if (count > cap) {
+      cap = count;
+      obs = realloc(obs, cap * sizeof(Pong_Observation));
+      wire = realloc(wire, cap * PONG_OBSERVATION_WIRE_SIZE);
+      actions = realloc(actions, cap);
+    }
+    if (!read_full(in, wire, count * PONG_OBSERVATION_WIRE_SIZE))
+      break;
+    for (uint32_t i = 0; i < count; i++) {
+      const uint8_t *w = wire + i * PONG_OBSERVATION_WIRE_SIZE;
+      Pong_Observation *o = &obs[i];
+      o->ball_x = get_lef32(w + 0);
+      o->ball_y = get_lef32(w + 4);
+      o->ball_vx = get_lef32(w + 8);
+      o->ball_vy = get_lef32(w + 12);
+      o->paddle_x = get_lef32(w + 16);
+      o->paddle_y = get_lef32(w + 20);
+      o->paddle_w = get_lef32(w + 24);
+      o->paddle_h = get_lef32(w + 28);
+      o->opponent_x = get_lef32(w + 32);
+      o->opponent_y = get_lef32(w + 36);
+      o->opponent_w = get_lef32(w + 40);
+      o->opponent_h = get_lef32(w + 44);
+      o->aspect_ratio = get_lef32(w + 48);
+      o->side = (int32_t)get_le32(w + 52);
+      o->score = (int32_t)get_le32(w + 56);
+      o->opponent_score = (int32_t)get_le32(w + 60);
+    }
+    follow_step(policy, obs, actions, count);
+    if (!write_full(out, actions, count))
+      break;
+  }
+  free(obs);
+  free(wire);
+  free(actions);
+}
+
+int main(int argc, char **argv) {
+  void *policy = follow_create(NULL);
+  if (argc < 2) {
+    serve(policy, STDIN_FILENO, STDOUT_FILENO);
+    follow_destroy(policy);
+    return 0;
+  }
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(argv[1]);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 8) != 0) {
+    perror("follow_ball");
+    return 1;
+  }
+  for (;;) {
+    int conn = accept(fd, NULL, NULL);
+    if (conn < 0)
+      break;
+    serve(policy, conn, conn);
+    close(conn);
+  }
+  follow_destroy(policy);
+  return 0;
+}
+#endif
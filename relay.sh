@@ -0,0 +1,7 @@
+#/usr/bin/sh
+
+gcc ./src/relay.c ./src/broadcast.c ./src/sim.c ./src/snapshot.c \
+./src/profile.c \
+-O3 -march=native -ffp-contract=off -Wall -Wswitch-enum -Wextra \
+-lm \
+-o pong_relay && ./pong_relay "$@"
@@ -1,5 +1,9 @@
 #/usr/bin/sh
 
-gcc ./src/main.c -O3 -Wall -Wswitch-enum -Wextra \
--lraylib \
+gcc ./src/main.c ./src/draw.c ./src/sim.c ./src/batch.c ./src/soa.c \
+./src/ai.c ./src/policy.c ./src/replay.c ./src/archive.c ./src/profile.c \
+./src/trace.c ./src/pacing.c ./src/input.c ./src/latency.c ./src/netplay.c \
+./src/broadcast.c ./src/snapshot.c ./src/multiball.c \
+-O3 -march=native -ffp-contract=off -Wall -Wswitch-enum -Wextra \
+-lraylib -ldl \
 -o pong && ./pong
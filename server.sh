@@ -0,0 +1,11 @@
+#/usr/bin/sh
+
+gcc ./src/server.c ./src/sim.c ./src/ai.c ./src/snapshot.c ./src/profile.c \
+-O3 -march=native -ffp-contract=off -Wall -Wswitch-enum -Wextra \
+-lm \
+-o pong_server &&
+gcc ./src/loadgen.c ./src/sim.c ./src/ai.c ./src/snapshot.c ./src/broadcast.c \
+./src/profile.c \
+-O3 -march=native -ffp-contract=off -Wall -Wswitch-enum -Wextra \
+-lm \
+-o loadgen && ./pong_server "$@"
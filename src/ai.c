@@ -0,0 +1,85 @@
+#include "ai.h"
+
+#include <math.h>
+
+void init_ai_config(Ai_Config *c) {
+  c->plan_interval = 6; // 40 predictions per second
+  c->max_reflections = 4;
+  c->dead_zone = 0.25f;
+}
+
+void ai_init(Ai_Controller *ai, Side side, const Ai_Config *c) {
+  ai->side = side;
+  ai->config = *c;
+  if (ai->config.plan_interval < 1)
+    ai->config.plan_interval = 1;
+  ai->ticks_to_plan = 0;
+  ai->target_y = SCREEN_HEIGHT / 2.0f;
+  ai->predictions = 0;
+}
+
+bool ai_predict_ball_y(const Ball *b, float face_x, float aspect_ratio,
+                       int max_reflections, float *out_y) {
+  float vx = b->vx * aspect_ratio;
+  if (vx == 0)
+    return false;
+  float t = (face_x - b->x) / vx;
+  if (t < 0)
+    return false;
+
+  // Unfold the bounces: the ball moves freely on a line and every crossing
+  // of a multiple of `span` is a wall bounce, so fold the end point back
+  // into [0, span] with a triangle wave.
+  float span = SCREEN_HEIGHT - BALL_SIZE * aspect_ratio;
+  float y = b->y + b->vy * t;
+  float crossings = floorf(y / span);
+  if (fabsf(crossings) > max_reflections)
+    return false;
+
+  float m = y - 2.0f * span * floorf(y / (2.0f * span));
+  *out_y = m > span ? 2.0f * span - m : m;
+  return true;
+}
+
+Input ai_decide(Ai_Controller *ai, const Ball *ball, const Paddle *paddle,
+                float aspect_ratio) {
+  if (--ai->ticks_to_plan <= 0) {
+    ai->ticks_to_plan = ai->config.plan_interval;
+    ai->predictions++;
+
+    float face = ai->side == Side_Left ? paddle->x + paddle->w
+                                       : paddle->x - BALL_SIZE;
+    float y;
+    if (ai_predict_ball_y(ball, face, aspect_ratio,
+                          ai->config.max_reflections, &y))
+      ai->target_y = y + BALL_SIZE * aspect_ratio / 2.0f;
+    else
+      ai->target_y = SCREEN_HEIGHT / 2.0f;
+  }
+
+  float diff = ai->target_y - (paddle->y + paddle->h / 2.0f);
+  if (fabsf(diff) <= ai->config.dead_zone * paddle->h / 2.0f)
+    return 0;
+
+  bool up = diff < 0;
+  if (ai->side == Side_Left)
+    return up ? Input_Left_Up : Input_Left_Down;
+  return up ? Input_Right_Up : Input_Right_Down;
+}
+
+Input ai_decide_state(Ai_Controller *ai, const State *s) {
+  const Paddle *paddle =
+      ai->side == Side_Left ? &s->left_paddle : &s->right_paddle;
+  return ai_decide(ai, &s->ball, paddle, s->aspect_ratio);
+}
+
+Input ai_side_mask(Side side) {
+  Input keys = side == Side_Left ? Input_Left_Up | Input_Left_Down
+                                 : Input_Right_Up | Input_Right_Down;
+  // Hold field i belongs to key bit i: the four bits at 4 * i.
+  Input holds = 0;
+  for (int i = 0; i < 4; i++)
+    if (keys & 1u << i)
+      holds |= 0xfu << (INPUT_HOLD_SHIFT + 4 * i);
+  return keys | holds;
+}
@@ -0,0 +1,52 @@
+#ifndef PONG_AI_H
+#define PONG_AI_H
+
+// Computer paddle. It plugs in where the keyboard does: ai_decide returns
+// the Input bits for its paddle, so the sim, replays and the batch runner
+// can't tell it from a player. The ball's path to the paddle face is
+// predicted in closed form, with top/bottom bounces folded in, so a
+// prediction costs the same however far away the ball is.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+typedef enum {
+  Side_Left,
+  Side_Right,
+} Side;
+
+// Compute budget and skill in one: a longer plan interval means fewer
+// predictions and a slower reaction, fewer reflections a shorter horizon.
+typedef struct {
+  int plan_interval;   // ticks between predictions, 1 re-plans every tick
+  int max_reflections; // wall bounces followed; past that, wait in the middle
+  float dead_zone;     // fraction of half the paddle treated as on target
+} Ai_Config;
+
+typedef struct {
+  Side side;
+  Ai_Config config;
+  int ticks_to_plan;
+  float target_y; // where the paddle centre is heading
+  uint64_t predictions;
+} Ai_Controller;
+
+void init_ai_config(Ai_Config *c);
+void ai_init(Ai_Controller *ai, Side side, const Ai_Config *c);
+
+// Ball y when it reaches x == face_x. Fails if the ball is moving away or
+// would bounce off the walls more than max_reflections times first.
+bool ai_predict_ball_y(const Ball *b, float face_x, float aspect_ratio,
+                       int max_reflections, float *out_y);
+
+// Paddle bits for this tick, only ever for ai->side.
+Input ai_decide(Ai_Controller *ai, const Ball *ball, const Paddle *paddle,
+                float aspect_ratio);
+Input ai_decide_state(Ai_Controller *ai, const State *s);
+
+// Every Input bit that belongs to one paddle, hold fields included.
+Input ai_side_mask(Side side);
+
+#endif
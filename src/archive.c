@@ -0,0 +1,307 @@
+#include "archive.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "replay.h"
+
+#define ARCHIVE_HEADER_SIZE 32
+#define ARCHIVE_MATCH_ENTRY_SIZE 40
+#define ARCHIVE_EVENT_SIZE 12
+
+typedef struct {
+  uint64_t tick_cnt;
+  uint64_t inputs_offset;
+  uint64_t keyframes_offset;
+  uint64_t events_offset;
+  uint32_t keyframe_cnt;
+  uint32_t event_cnt;
+} Archive_Match;
+
+static Archive_Match read_match(const Archive *a, uint32_t match) {
+  Archive_Match m;
+  const uint8_t *p =
+      a->match_table + (size_t)match * ARCHIVE_MATCH_ENTRY_SIZE;
+  p = get_u64(p, &m.tick_cnt);
+  p = get_u64(p, &m.inputs_offset);
+  p = get_u64(p, &m.keyframes_offset);
+  p = get_u64(p, &m.events_offset);
+  p = get_u32(p, &m.keyframe_cnt);
+  get_u32(p, &m.event_cnt);
+  return m;
+}
+
+static bool match_fits(const Archive *a, const Archive_Match *m) {
+  uint64_t inputs_end = m->inputs_offset + m->tick_cnt * 4;
+  uint64_t keyframes_end =
+      m->keyframes_offset + (uint64_t)m->keyframe_cnt * STATE_BLOB_SIZE;
+  uint64_t events_end =
+      m->events_offset + (uint64_t)m->event_cnt * ARCHIVE_EVENT_SIZE;
+  uint64_t needed_keyframes =
+      (m->tick_cnt + a->keyframe_interval - 1) / a->keyframe_interval;
+  return inputs_end <= a->size && keyframes_end <= a->size &&
+         events_end <= a->size && m->keyframe_cnt >= needed_keyframes &&
+         m->keyframe_cnt > 0;
+}
+
+bool archive_open(Archive *a, const char *path) {
+  a->fd = open(path, O_RDONLY);
+  if (a->fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(a->fd, &st) != 0 || st.st_size < ARCHIVE_HEADER_SIZE) {
+    close(a->fd);
+    return false;
+  }
+  a->size = st.st_size;
+  a->data = mmap(NULL, a->size, PROT_READ, MAP_SHARED, a->fd, 0);
+  if (a->data == MAP_FAILED) {
+    close(a->fd);
+    return false;
+  }
+
+  uint32_t version, tick_rate;
+  uint64_t table_offset;
+  const uint8_t *p = a->data + sizeof(ARCHIVE_MAGIC);
+  p = get_u32(p, &version);
+  p = get_u32(p, &tick_rate);
+  p = get_u32(p, &a->keyframe_interval);
+  p = get_u32(p, &a->match_cnt);
+  get_u64(p, &table_offset);
+
+  bool ok = memcmp(a->data, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0 &&
+            version == ARCHIVE_VERSION && tick_rate == TICK_RATE &&
+            a->keyframe_interval > 0 && table_offset <= a->size &&
+            (a->size - table_offset) / ARCHIVE_MATCH_ENTRY_SIZE >=
+                a->match_cnt;
+  if (ok) {
+    a->match_table = a->data + table_offset;
+    for (uint32_t i = 0; i < a->match_cnt && ok; i++) {
+      Archive_Match m = read_match(a, i);
+      ok = match_fits(a, &m);
+    }
+  }
+  if (!ok) {
+    archive_close(a);
+    return false;
+  }
+
+  // Seeks jump around, don't let the kernel read ahead for nothing.
+  madvise((void *)a->data, a->size, MADV_RANDOM);
+  return true;
+}
+
+void archive_close(Archive *a) {
+  munmap((void *)a->data, a->size);
+  close(a->fd);
+  a->data = NULL;
+  a->fd = -1;
+}
+
+uint64_t archive_match_ticks(const Archive *a, uint32_t match) {
+  return read_match(a, match).tick_cnt;
+}
+
+static void apply_events(const Archive *a, const Archive_Match *m,
+                         uint64_t tick, State *s) {
+  // Events are sorted by tick; find the first one at or after tick.
+  uint32_t lo = 0, hi = m->event_cnt;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint64_t event_tick;
+    get_u64(a->data + m->events_offset + (size_t)mid * ARCHIVE_EVENT_SIZE,
+            &event_tick);
+    if (event_tick < tick)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for (; lo < m->event_cnt; lo++) {
+    const uint8_t *p =
+        a->data + m->events_offset + (size_t)lo * ARCHIVE_EVENT_SIZE;
+    uint64_t event_tick;
+    p = get_u64(p, &event_tick);
+    if (event_tick != tick)
+      break;
+    get_f32(p, &s->aspect_ratio);
+  }
+}
+
+static bool step_match(const Archive *a, const Archive_Match *m,
+                       uint64_t *tick, State *s) {
+  if (*tick >= m->tick_cnt)
+    return false;
+
+  uint32_t input;
+  apply_events(a, m, *tick, s);
+  get_u32(a->data + m->inputs_offset + *tick * 4, &input);
+  update_state(s, input, TICK_DELTA);
+  *tick += 1;
+  return true;
+}
+
+void archive_seek(const Archive *a, uint32_t match, uint64_t tick, State *s) {
+  Archive_Match m = read_match(a, match);
+  if (tick > m.tick_cnt)
+    tick = m.tick_cnt;
+
+  uint64_t keyframe = tick / a->keyframe_interval;
+  if (keyframe >= m.keyframe_cnt)
+    keyframe = m.keyframe_cnt - 1;
+  unpack_state(a->data + m.keyframes_offset + keyframe * STATE_BLOB_SIZE, s);
+
+  uint64_t t = keyframe * a->keyframe_interval;
+  while (t < tick)
+    step_match(a, &m, &t, s);
+}
+
+bool archive_step(const Archive *a, uint32_t match, uint64_t *tick,
+                  State *s) {
+  Archive_Match m = read_match(a, match);
+  return step_match(a, &m, tick, s);
+}
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+} Byte_Buffer;
+
+static uint8_t *buffer_grow(Byte_Buffer *b, size_t n) {
+  if (b->len + n > b->cap) {
+    size_t cap = b->cap ? b->cap * 2 : 4096;
+    while (cap < b->len + n)
+      cap *= 2;
+    uint8_t *data = realloc(b->data, cap);
+    if (!data) {
+      fprintf(stderr, "archive: out of memory\n");
+      exit(1);
+    }
+    b->data = data;
+    b->cap = cap;
+  }
+  uint8_t *p = b->data + b->len;
+  b->len += n;
+  return p;
+}
+
+typedef struct {
+  Byte_Buffer inputs;
+  Byte_Buffer keyframes;
+  Byte_Buffer events;
+  uint64_t tick_cnt;
+} Match_Builder;
+
+static void reset_builder(Match_Builder *mb) {
+  mb->inputs.len = 0;
+  mb->keyframes.len = 0;
+  mb->events.len = 0;
+  mb->tick_cnt = 0;
+}
+
+// Appends the built match to the archive body and its entry to the table.
+static bool flush_builder(FILE *f, uint64_t *offset, Match_Builder *mb,
+                          Byte_Buffer *table) {
+  if (mb->tick_cnt == 0)
+    return true;
+
+  uint8_t *p = buffer_grow(table, ARCHIVE_MATCH_ENTRY_SIZE);
+  p = put_u64(p, mb->tick_cnt);
+  p = put_u64(p, *offset);
+  p = put_u64(p, *offset + mb->inputs.len);
+  p = put_u64(p, *offset + mb->inputs.len + mb->keyframes.len);
+  p = put_u32(p, mb->keyframes.len / STATE_BLOB_SIZE);
+  put_u32(p, mb->events.len / ARCHIVE_EVENT_SIZE);
+
+  Byte_Buffer *parts[] = {&mb->inputs, &mb->keyframes, &mb->events};
+  for (int i = 0; i < 3; i++) {
+    if (fwrite(parts[i]->data, 1, parts[i]->len, f) != parts[i]->len)
+      return false;
+    *offset += parts[i]->len;
+  }
+  reset_builder(mb);
+  return true;
+}
+
+bool archive_build(const char *path, const char **replay_paths,
+                   int replay_cnt) {
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return false;
+
+  uint8_t header[ARCHIVE_HEADER_SIZE] = {0};
+  fwrite(header, 1, sizeof(header), f);
+
+  Match_Builder mb = {0};
+  Byte_Buffer table = {0};
+  uint64_t offset = ARCHIVE_HEADER_SIZE;
+  bool ok = true;
+
+  for (int i = 0; i < replay_cnt && ok; i++) {
+    Replay_Reader r;
+    if (!replay_reader_open(&r, replay_paths[i])) {
+      fprintf(stderr, "archive: skipping unreadable replay %s\n",
+              replay_paths[i]);
+      continue;
+    }
+
+    State s;
+    init_state(&s, r.header.seed);
+    uint32_t match_cnt = 0;
+    float aspect_ratio = s.aspect_ratio;
+    Input input;
+
+    while (ok && replay_next_tick(&r, &s, &input)) {
+      if (r.match_cnt != match_cnt) {
+        ok = flush_builder(f, &offset, &mb, &table);
+        match_cnt = r.match_cnt;
+      } else if (s.aspect_ratio != aspect_ratio) {
+        uint8_t *p = buffer_grow(&mb.events, ARCHIVE_EVENT_SIZE);
+        p = put_u64(p, mb.tick_cnt);
+        put_f32(p, s.aspect_ratio);
+      }
+      aspect_ratio = s.aspect_ratio;
+
+      if (mb.tick_cnt % ARCHIVE_KEYFRAME_INTERVAL == 0)
+        pack_state(&s, buffer_grow(&mb.keyframes, STATE_BLOB_SIZE));
+      put_u32(buffer_grow(&mb.inputs, 4), input);
+      mb.tick_cnt++;
+
+      update_state(&s, input, TICK_DELTA);
+    }
+    if (ok)
+      ok = flush_builder(f, &offset, &mb, &table);
+    if (r.desyncs)
+      fprintf(stderr, "archive: %s desynced %llu times\n", replay_paths[i],
+              (unsigned long long)r.desyncs);
+    replay_reader_close(&r);
+  }
+
+  uint32_t match_cnt = table.len / ARCHIVE_MATCH_ENTRY_SIZE;
+  ok = ok && fwrite(table.data, 1, table.len, f) == table.len;
+
+  uint8_t *p = header;
+  memcpy(p, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+  p += sizeof(ARCHIVE_MAGIC);
+  p = put_u32(p, ARCHIVE_VERSION);
+  p = put_u32(p, TICK_RATE);
+  p = put_u32(p, ARCHIVE_KEYFRAME_INTERVAL);
+  p = put_u32(p, match_cnt);
+  put_u64(p, offset);
+  ok = ok && fseek(f, 0, SEEK_SET) == 0 &&
+       fwrite(header, 1, sizeof(header), f) == sizeof(header);
+  ok = fclose(f) == 0 && ok;
+
+  free(mb.inputs.data);
+  free(mb.keyframes.data);
+  free(mb.events.data);
+  free(table.data);
+  return ok;
+}
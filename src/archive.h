@@ -0,0 +1,55 @@
+#ifndef PONG_ARCHIVE_H
+#define PONG_ARCHIVE_H
+
+// Seekable archive of many matches, built from replay files and read
+// through mmap. Each match stores one Input per tick plus a keyframe State
+// every keyframe_interval ticks, so reaching any tick means restoring one
+// keyframe and simulating fewer than keyframe_interval ticks.
+//
+// Layout, all integers little-endian:
+//
+//   header       "PONGARC\0" u32 version u32 tick_rate
+//                u32 keyframe_interval u32 match_cnt u64 match_table_offset
+//   per match    u32 input[tick_cnt]
+//                u8 keyframe[keyframe_cnt][STATE_BLOB_SIZE]
+//                { u64 tick, u32 aspect_bits }[event_cnt]
+//   match table  { u64 tick_cnt, u64 inputs_offset, u64 keyframes_offset,
+//                  u64 events_offset, u32 keyframe_cnt, u32 event_cnt }[]
+//
+// Events are window aspect ratio changes, applied before their tick.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+#define ARCHIVE_MAGIC "PONGARC"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_KEYFRAME_INTERVAL TICK_RATE // one second of play
+
+typedef struct {
+  int fd;
+  const uint8_t *data;
+  size_t size;
+  uint32_t keyframe_interval;
+  uint32_t match_cnt;
+  const uint8_t *match_table;
+} Archive;
+
+bool archive_open(Archive *a, const char *path);
+void archive_close(Archive *a);
+
+uint64_t archive_match_ticks(const Archive *a, uint32_t match);
+// State of the match after `tick` ticks, tick <= archive_match_ticks.
+void archive_seek(const Archive *a, uint32_t match, uint64_t tick, State *s);
+// Plays tick *tick of the match on s and advances *tick. Returns false at the
+// end of the match.
+bool archive_step(const Archive *a, uint32_t match, uint64_t *tick, State *s);
+
+// Re-simulates every match of the given replays into a new archive. Prints
+// what it skipped to stderr; returns false if nothing could be written.
+bool archive_build(const char *path, const char **replay_paths,
+                   int replay_cnt);
+
+#endif
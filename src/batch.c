@@ -0,0 +1,377 @@
+#include "batch.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "policy.h"
+#include "sim.h"
+#include "soa.h"
+
+#define MAX_BATCH_THREADS 256
+#define BOT_INPUT_HOLD_TICKS 24 // bots re-roll their keys every 0.1s
+
+// Each worker owns a contiguous range of work units packed as
+// (head << 32 | tail) in one atomic word. The owner pops from the head,
+// idle workers steal from the tail of a victim. Matches vary wildly in
+// length, so a static split leaves cores idle at the end of a batch.
+typedef struct {
+  _Alignas(64) atomic_uint_least64_t range;
+} Work_Queue;
+
+typedef struct {
+  const Batch_Config *config;
+  Match_Result *results;
+  Work_Queue *queues;
+  int queue_cnt;
+  int index;
+  uint64_t ticks;
+  uint64_t steals;
+  Policy policy;
+  bool has_policy;
+  bool policy_failed;
+} Worker;
+
+typedef struct {
+  Rng input_rng;
+  Input input;
+  Ai_Controller ai[2]; // by Side, when the config asks for AI players
+  uint64_t ticks;
+} Bot;
+
+static uint64_t pack_range(uint32_t head, uint32_t tail) {
+  return (uint64_t)head << 32 | tail;
+}
+
+static bool pop_head(Work_Queue *q, uint32_t *out) {
+  uint64_t range = atomic_load(&q->range);
+  for (;;) {
+    uint32_t head = range >> 32;
+    uint32_t tail = (uint32_t)range;
+    if (head >= tail)
+      return false;
+    if (atomic_compare_exchange_weak(&q->range, &range,
+                                     pack_range(head + 1, tail))) {
+      *out = head;
+      return true;
+    }
+  }
+}
+
+static bool steal_tail(Work_Queue *q, uint32_t *out) {
+  uint64_t range = atomic_load(&q->range);
+  for (;;) {
+    uint32_t head = range >> 32;
+    uint32_t tail = (uint32_t)range;
+    if (head >= tail)
+      return false;
+    if (atomic_compare_exchange_weak(&q->range, &range,
+                                     pack_range(head, tail - 1))) {
+      *out = tail - 1;
+      return true;
+    }
+  }
+}
+
+static Input roll_bot_input(Rng *r) {
+  return rng_next(r) >> 60 &
+         (Input_Left_Up | Input_Left_Down | Input_Right_Up | Input_Right_Down);
+}
+
+static void init_match(const Batch_Config *c, State *s, Bot *bot,
+                       uint64_t seed) {
+  init_state(s, seed);
+  s->step = Step_Running;
+  s->pause = false;
+  rng_seed(&bot->input_rng, ~seed);
+  bot->input = 0;
+  bot->ticks = 0;
+  ai_init(&bot->ai[Side_Left], Side_Left, &c->ai_config);
+  ai_init(&bot->ai[Side_Right], Side_Right, &c->ai_config);
+}
+
+static Input next_bot_input(const Batch_Config *c, Bot *bot,
+                            const Ball *ball, const Paddle *left,
+                            const Paddle *right, float aspect_ratio) {
+  if (c->ai)
+    return ai_decide(&bot->ai[Side_Left], ball, left, aspect_ratio) |
+           ai_decide(&bot->ai[Side_Right], ball, right, aspect_ratio);
+
+  if (bot->ticks % BOT_INPUT_HOLD_TICKS == 0)
+    bot->input = roll_bot_input(&bot->input_rng);
+  return bot->input;
+}
+
+// Replaces the right paddle bits of inputs[i] with the policy's action for
+// obs[i], in one call for the whole batch.
+static void apply_policy(Worker *w, const Pong_Observation *obs,
+                         Input **inputs, uint32_t count) {
+  uint8_t actions[SOA_LANES];
+  if (!policy_step(&w->policy, obs, actions, count))
+    w->policy_failed = true;
+  for (uint32_t i = 0; i < count; i++)
+    *inputs[i] = (*inputs[i] & ~ai_side_mask(Side_Right)) |
+                 policy_action_input(Side_Right, actions[i]);
+}
+
+static bool out_of_ticks(const Batch_Config *c, const Bot *bot) {
+  return c->max_ticks != 0 && bot->ticks >= c->max_ticks;
+}
+
+// Called after every tick. Returns true once the match is over, otherwise
+// serves the next point if one was just scored.
+static bool finish_tick(const Batch_Config *c, State *s, Bot *bot,
+                        Match_Result *r) {
+  bool finished = false;
+  if (s->step == Step_Win_Screen) {
+    if (s->left_player_score >= c->points_to_win ||
+        s->right_player_score >= c->points_to_win) {
+      finished = true;
+    } else {
+      init_game_field(s);
+      s->step = Step_Running;
+    }
+  }
+
+  if (!finished && !out_of_ticks(c, bot))
+    return false;
+
+  r->left_score = s->left_player_score;
+  r->right_score = s->right_player_score;
+  r->ticks = bot->ticks;
+  r->finished = finished;
+  return true;
+}
+
+static uint64_t simulate_match(Worker *w, uint64_t seed, Match_Result *r) {
+  const Batch_Config *c = w->config;
+  State s;
+  Bot bot;
+  init_match(c, &s, &bot, seed);
+  r->seed = seed;
+
+  do {
+    Input input = next_bot_input(c, &bot, &s.ball, &s.left_paddle,
+                                 &s.right_paddle, s.aspect_ratio);
+    if (w->has_policy) {
+      Pong_Observation obs;
+      Input *inputs[1] = {&input};
+      policy_observe_state(&s, Side_Right, &obs);
+      apply_policy(w, &obs, inputs, 1);
+    }
+    update_state(&s, input, TICK_DELTA);
+    bot.ticks++;
+  } while (!finish_tick(c, &s, &bot, r));
+
+  return bot.ticks;
+}
+
+// Plays up to SOA_LANES consecutive matches side by side in one Match_Block.
+// Finished lanes drop out of used_bits while the rest keep going.
+static uint64_t simulate_block(Worker *w, uint32_t first,
+                               Match_Result *results) {
+  const Batch_Config *c = w->config;
+  Match_Block block;
+  Bot bots[SOA_LANES];
+  uint32_t count = c->match_cnt - first;
+  if (count > SOA_LANES)
+    count = SOA_LANES;
+
+  block.used_bits = 0;
+  for (uint32_t lane = 0; lane < count; lane++) {
+    State s;
+    init_match(c, &s, &bots[lane], c->seed + first + lane);
+    soa_store_lane(&block, lane, &s);
+    block.used_bits |= 1u << lane;
+    results[first + lane].seed = c->seed + first + lane;
+  }
+  for (uint32_t lane = count; lane < SOA_LANES; lane++)
+    block.input[lane] = 0;
+
+  uint64_t ticks = 0;
+  while (block.used_bits) {
+    Pong_Observation obs[SOA_LANES];
+    Input *policy_inputs[SOA_LANES];
+    uint32_t obs_cnt = 0;
+    for (uint32_t lane = 0; lane < count; lane++) {
+      if (!(block.used_bits & 1u << lane))
+        continue;
+      Ball ball = {block.ball_x[lane], block.ball_y[lane], block.ball_vx[lane],
+                   block.ball_vy[lane]};
+      Paddle left = {block.left_x[lane], block.left_y[lane],
+                     block.left_h[lane], block.left_w[lane]};
+      Paddle right = {block.right_x[lane], block.right_y[lane],
+                      block.right_h[lane], block.right_w[lane]};
+      block.input[lane] = next_bot_input(c, &bots[lane], &ball, &left, &right,
+                                         block.aspect_ratio[lane]);
+      if (w->has_policy) {
+        const State *s = &block.lanes[lane];
+        policy_observe(&ball, &right, &left, block.aspect_ratio[lane],
+                       Side_Right, s->right_player_score,
+                       s->left_player_score, &obs[obs_cnt]);
+        policy_inputs[obs_cnt++] = &block.input[lane];
+      }
+    }
+    if (obs_cnt > 0)
+      apply_policy(w, obs, policy_inputs, obs_cnt);
+
+    soa_update_block(&block, TICK_DELTA);
+
+    for (uint32_t lane = 0; lane < count; lane++) {
+      if (!(block.used_bits & 1u << lane))
+        continue;
+
+      // Most ticks neither score nor hit the cap, skip the lane round trip.
+      bots[lane].ticks++;
+      if (block.lanes[lane].step != Step_Win_Screen &&
+          !out_of_ticks(c, &bots[lane]))
+        continue;
+
+      State s;
+      soa_load_lane(&block, lane, &s);
+      if (finish_tick(c, &s, &bots[lane], &results[first + lane])) {
+        block.used_bits &= ~(1u << lane);
+        ticks += bots[lane].ticks;
+      } else {
+        soa_store_lane(&block, lane, &s);
+      }
+    }
+  }
+
+  return ticks;
+}
+
+static uint64_t run_unit(Worker *w, uint32_t unit) {
+  const Batch_Config *c = w->config;
+  if (!c->use_soa)
+    return simulate_match(w, c->seed + unit, &w->results[unit]);
+  return simulate_block(w, unit * SOA_LANES, w->results);
+}
+
+static int worker_main(void *arg) {
+  Worker *w = arg;
+  uint32_t unit;
+
+  for (;;) {
+    if (pop_head(&w->queues[w->index], &unit)) {
+      w->ticks += run_unit(w, unit);
+      continue;
+    }
+
+    bool stole = false;
+    for (int i = 1; i < w->queue_cnt && !stole; i++) {
+      Work_Queue *victim = &w->queues[(w->index + i) % w->queue_cnt];
+      stole = steal_tail(victim, &unit);
+    }
+    if (!stole)
+      break;
+
+    w->steals++;
+    w->ticks += run_unit(w, unit);
+  }
+
+  return 0;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void init_batch_config(Batch_Config *c) {
+  c->match_cnt = 1000;
+  c->thread_cnt = 0;
+  c->seed = 1;
+  c->points_to_win = 11;
+  c->max_ticks = (uint64_t)TICK_RATE * 60 * 30; // half an hour of play
+  c->use_soa = true;
+  c->ai = false;
+  init_ai_config(&c->ai_config);
+  c->policy_spec = NULL;
+}
+
+bool run_batch(const Batch_Config *c, Match_Result *results,
+               Batch_Report *report) {
+  int thread_cnt = c->thread_cnt;
+  if (thread_cnt <= 0)
+    thread_cnt = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (thread_cnt <= 0)
+    thread_cnt = 1;
+  if (thread_cnt > MAX_BATCH_THREADS)
+    thread_cnt = MAX_BATCH_THREADS;
+  int unit_cnt = c->use_soa ? (c->match_cnt + SOA_LANES - 1) / SOA_LANES
+                            : c->match_cnt;
+  if (thread_cnt > unit_cnt && unit_cnt > 0)
+    thread_cnt = unit_cnt;
+
+  Work_Queue *queues = aligned_alloc(64, sizeof(Work_Queue) * thread_cnt);
+  Worker *workers = calloc(thread_cnt, sizeof(Worker));
+  thrd_t *threads = calloc(thread_cnt, sizeof(thrd_t));
+  if (!queues || !workers || !threads) {
+    free(queues);
+    free(workers);
+    free(threads);
+    return false;
+  }
+
+  for (int i = 0; i < thread_cnt; i++) {
+    uint32_t head = (uint64_t)unit_cnt * i / thread_cnt;
+    uint32_t tail = (uint64_t)unit_cnt * (i + 1) / thread_cnt;
+    atomic_init(&queues[i].range, pack_range(head, tail));
+    workers[i].config = c;
+    workers[i].results = results;
+    workers[i].queues = queues;
+    workers[i].queue_cnt = thread_cnt;
+    workers[i].index = i;
+  }
+
+  bool policies_ok = true;
+  for (int i = 0; i < thread_cnt && c->policy_spec && policies_ok; i++) {
+    policies_ok = policy_open(&workers[i].policy, c->policy_spec);
+    workers[i].has_policy = policies_ok;
+  }
+  if (!policies_ok) {
+    for (int i = 0; i < thread_cnt; i++)
+      if (workers[i].has_policy)
+        policy_close(&workers[i].policy);
+    free(queues);
+    free(workers);
+    free(threads);
+    return false;
+  }
+
+  double start = now_seconds();
+
+  // Worker 0 runs on the calling thread.
+  int started = 1;
+  for (int i = 1; i < thread_cnt; i++) {
+    if (thrd_create(&threads[i], worker_main, &workers[i]) != thrd_success)
+      break;
+    started++;
+  }
+  // Queues of workers that failed to start are drained by stealing.
+  worker_main(&workers[0]);
+  for (int i = 1; i < started; i++)
+    thrd_join(threads[i], NULL);
+
+  report->seconds = now_seconds() - start;
+  report->thread_cnt = started;
+  report->total_ticks = 0;
+  report->steals = 0;
+  report->policy_failed = false;
+  for (int i = 0; i < thread_cnt; i++) {
+    report->total_ticks += workers[i].ticks;
+    report->steals += workers[i].steals;
+    report->policy_failed |= workers[i].policy_failed;
+    if (workers[i].has_policy)
+      policy_close(&workers[i].policy);
+  }
+
+  free(queues);
+  free(workers);
+  free(threads);
+  return true;
+}
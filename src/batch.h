@@ -0,0 +1,48 @@
+#ifndef PONG_BATCH_H
+#define PONG_BATCH_H
+
+// Windowless batch runner: plays many independent matches on every core.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ai.h"
+
+typedef struct {
+  int match_cnt;
+  int thread_cnt;     // 0 picks one worker per online core
+  uint64_t seed;      // match i is seeded with seed + i
+  int points_to_win;  // a match ends when either side reaches this
+  uint64_t max_ticks; // hard cap per match, 0 for none
+  bool use_soa;       // step SOA_LANES matches per SIMD block
+  bool ai;            // both paddles played by Ai_Controller, not random keys
+  Ai_Config ai_config;
+  // Spec for policy_open that plays the right paddle, NULL for none. Each
+  // worker opens its own and steps a whole SoA block per call.
+  const char *policy_spec;
+} Batch_Config;
+
+typedef struct {
+  uint64_t seed;
+  int left_score;
+  int right_score;
+  uint64_t ticks;
+  bool finished; // false if max_ticks cut the match short
+} Match_Result;
+
+typedef struct {
+  uint64_t total_ticks;
+  double seconds;
+  int thread_cnt;
+  uint64_t steals;
+  bool policy_failed; // a policy step failed, its paddle stood still after
+} Batch_Report;
+
+void init_batch_config(Batch_Config *c);
+// results must hold c->match_cnt entries. Returns false on allocation
+// failure or if the policy can't be opened. If some threads fail to start
+// the rest steal their matches.
+bool run_batch(const Batch_Config *c, Match_Result *results,
+               Batch_Report *report);
+
+#endif
@@ -0,0 +1,407 @@
+// Micro-benchmarks for the simulation and render paths. Prints one JSON
+// document so runs can be diffed between versions:
+//
+//   {"tick_rate": 240, "kernel": "avx2", "results": [
+//     {"name": "physics_tick", "unit": "ns/tick", "median": 12.3,
+//      "min": 12.1, "max": 12.9, "runs": 5, "ops": 5120000}, ...]}
+//
+// Every workload is seeded, so two runs do the same work.
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ai.h"
+#include "batch.h"
+#include "draw.h"
+#include "multiball.h"
+#include "profile.h"
+#include "sim.h"
+#include "snapshot.h"
+#include "soa.h"
+#include "vec_env.h"
+
+#define BENCH_RUNS 5
+#define BENCH_SEED 1
+#define PHYSICS_MATCHES 256
+#define PHYSICS_TICKS 20000
+#define BATCH_MATCHES 512
+#define AI_DECISIONS 2000000
+#define SNAPSHOT_TICKS 200000
+#define SNAPSHOT_EVERY 4 // ticks between snapshots, as pong_server sends
+#define VEC_ENVS 4096
+#define VEC_STEPS 200
+#define MULTIBALL_TICKS 480 // two seconds of play
+#define DRAW_FRAMES 2000
+#define DRAW_CALLS_PER_FRAME 16
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  double samples[BENCH_RUNS];
+  int run_cnt;
+  uint64_t ops;
+  bool skipped;
+} Bench_Result;
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// update_paddles + update_ball over PHYSICS_MATCHES running matches driven by
+// seeded random keys. Adds the bounce count to *collisions.
+static double bench_physics_once(uint64_t *collisions) {
+  static State states[PHYSICS_MATCHES];
+  Rng input_rng;
+  rng_seed(&input_rng, BENCH_SEED);
+  for (int i = 0; i < PHYSICS_MATCHES; i++) {
+    init_state(&states[i], BENCH_SEED + i);
+    states[i].step = Step_Running;
+    states[i].pause = false;
+  }
+
+  uint64_t bounces = 0;
+  uint64_t start = profile_now_ns();
+  for (int tick = 0; tick < PHYSICS_TICKS; tick++) {
+    Input input = rng_next(&input_rng) >> 60;
+    for (int i = 0; i < PHYSICS_MATCHES; i++) {
+      State *s = &states[i];
+      update_paddles(s, input, TICK_DELTA);
+      bounces += update_ball(s, TICK_DELTA);
+      if (s->step == Step_Win_Screen) {
+        init_game_field(s);
+        s->step = Step_Running;
+      }
+    }
+  }
+  double elapsed = profile_now_ns() - start;
+
+  *collisions += bounces;
+  return elapsed;
+}
+
+static void bench_physics(Bench_Result *tick, Bench_Result *collisions) {
+  uint64_t ops = (uint64_t)PHYSICS_MATCHES * PHYSICS_TICKS;
+  tick->name = "physics_tick";
+  tick->unit = "ns/tick";
+  tick->ops = ops;
+  collisions->name = "collisions";
+  collisions->unit = "collisions/sec";
+
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    uint64_t bounces = 0;
+    double elapsed = bench_physics_once(&bounces);
+    tick->samples[run] = elapsed / ops;
+    collisions->samples[run] = bounces / (elapsed / 1e9);
+    collisions->ops = bounces;
+  }
+  tick->run_cnt = BENCH_RUNS;
+  collisions->run_cnt = BENCH_RUNS;
+}
+
+static void bench_batch(Bench_Result *r, bool use_soa) {
+  Batch_Config c;
+  init_batch_config(&c);
+  c.match_cnt = BATCH_MATCHES;
+  c.thread_cnt = 1;
+  c.seed = BENCH_SEED;
+  c.use_soa = use_soa;
+
+  Match_Result *results = calloc(c.match_cnt, sizeof(Match_Result));
+  r->name = use_soa ? "batch_soa_tick" : "batch_aos_tick";
+  r->unit = "ns/tick";
+  for (int run = 0; run < BENCH_RUNS && results; run++) {
+    Batch_Report report;
+    if (!run_batch(&c, results, &report))
+      break;
+    r->samples[r->run_cnt++] = report.seconds * 1e9 / report.total_ticks;
+    r->ops = report.total_ticks;
+  }
+  r->skipped = r->run_cnt == 0;
+  free(results);
+}
+
+// ai_decide re-planning every tick, so every call runs the predictor, over
+// a spread of seeded ball positions and velocities.
+static void bench_ai(Bench_Result *r) {
+  r->name = "ai_decide";
+  r->unit = "ns/decision";
+  r->ops = AI_DECISIONS;
+
+  Ai_Config config;
+  init_ai_config(&config);
+  config.plan_interval = 1;
+  config.max_reflections = 1000;
+  Ai_Controller ai;
+  ai_init(&ai, Side_Right, &config);
+
+  State s;
+  init_state(&s, BENCH_SEED);
+  Rng rng;
+  rng_seed(&rng, BENCH_SEED);
+  enum { BALL_CNT = 1024 };
+  static Ball balls[BALL_CNT];
+  for (int i = 0; i < BALL_CNT; i++) {
+    balls[i].x = rng_range(&rng, 0, 1000) / 1000.0f;
+    balls[i].y = rng_range(&rng, 0, 1000) / 1000.0f;
+    balls[i].vx = rng_range(&rng, -200, 200) / 100.0f;
+    balls[i].vy = rng_range(&rng, -200, 200) / 100.0f;
+  }
+
+  Input sink = 0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    uint64_t start = profile_now_ns();
+    for (int i = 0; i < AI_DECISIONS; i++)
+      sink ^= ai_decide(&ai, &balls[i % BALL_CNT], &s.right_paddle,
+                        s.aspect_ratio);
+    double elapsed = profile_now_ns() - start;
+    r->samples[run] = elapsed / AI_DECISIONS;
+  }
+  r->run_cnt = BENCH_RUNS;
+  // Keep the calls from being optimized out.
+  if (sink == 0xffffffffu)
+    fprintf(stderr, "\n");
+}
+
+// Delta encoding a running match every SNAPSHOT_EVERY ticks against the
+// previous snapshot, plus the average encoded size.
+static void bench_snapshot(Bench_Result *r, Bench_Result *size) {
+  r->name = "snapshot_delta";
+  r->unit = "ns/snapshot";
+  r->ops = SNAPSHOT_TICKS / SNAPSHOT_EVERY;
+  size->name = "snapshot_delta_size";
+  size->unit = "bytes/snapshot";
+  size->ops = r->ops;
+
+  static Snapshot snapshots[SNAPSHOT_TICKS / SNAPSHOT_EVERY];
+  State s;
+  init_state(&s, BENCH_SEED);
+  s.step = Step_Running;
+  s.pause = false;
+  Rng input_rng;
+  rng_seed(&input_rng, BENCH_SEED);
+  Input input = 0;
+  for (int tick = 0; tick < SNAPSHOT_TICKS; tick++) {
+    if (tick % 24 == 0)
+      input = rng_next(&input_rng) >> 60;
+    update_state(&s, input, TICK_DELTA);
+    if (s.step == Step_Win_Screen) {
+      init_game_field(&s);
+      s.step = Step_Running;
+    }
+    if (tick % SNAPSHOT_EVERY == 0)
+      snapshot_quantize(&s, &snapshots[tick / SNAPSHOT_EVERY]);
+  }
+
+  uint8_t buffer[SNAPSHOT_MAX_SIZE];
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    uint64_t bytes = 0;
+    uint64_t start = profile_now_ns();
+    for (uint64_t i = 1; i < r->ops; i++)
+      bytes += snapshot_encode(&snapshots[i], &snapshots[i - 1], buffer);
+    double elapsed = profile_now_ns() - start;
+    r->samples[run] = elapsed / (r->ops - 1);
+    size->samples[run] = (double)bytes / (r->ops - 1);
+  }
+  r->run_cnt = BENCH_RUNS;
+  size->run_cnt = BENCH_RUNS;
+}
+
+// vec_env_step over VEC_ENVS environments with seeded random actions, per
+// environment step (ticks_per_step ticks each).
+static void bench_vec_env(Bench_Result *r) {
+  r->name = "vec_env_step";
+  r->unit = "ns/env-step";
+  r->ops = (uint64_t)VEC_ENVS * VEC_STEPS;
+
+  Vec_Env_Config config;
+  init_vec_env_config(&config);
+  Vec_Env env;
+  static uint64_t seeds[VEC_ENVS];
+  static uint8_t actions[VEC_STEPS][VEC_ENVS];
+  if (!vec_env_init(&env, VEC_ENVS, &config)) {
+    r->skipped = true;
+    return;
+  }
+  Rng rng;
+  rng_seed(&rng, BENCH_SEED);
+  for (int i = 0; i < VEC_ENVS; i++)
+    seeds[i] = BENCH_SEED + i;
+  for (int step = 0; step < VEC_STEPS; step++)
+    for (int i = 0; i < VEC_ENVS; i++)
+      actions[step][i] = rng_range(&rng, Pong_Action_None, Pong_Action_Down);
+
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    vec_env_reset(&env, seeds);
+    uint64_t start = profile_now_ns();
+    for (int step = 0; step < VEC_STEPS; step++)
+      vec_env_step(&env, actions[step]);
+    double elapsed = profile_now_ns() - start;
+    r->samples[run] = elapsed / r->ops;
+  }
+  r->run_cnt = BENCH_RUNS;
+  vec_env_free(&env);
+}
+
+// multiball_update with `ball_cnt` balls and seeded random paddle keys, per
+// ball per tick. The paddle_tests result is how many balls per tick the grid
+// hands to the paddles for the 100k run, against ball_cnt * 2 without it.
+static void bench_multiball(Bench_Result *r, const char *name, int ball_cnt,
+                            bool ball_collisions, Bench_Result *tests) {
+  r->name = name;
+  r->unit = "ns/ball-tick";
+  r->ops = (uint64_t)ball_cnt * MULTIBALL_TICKS;
+  if (tests) {
+    tests->name = "multiball_paddle_tests";
+    tests->unit = "balls/tick";
+    tests->ops = MULTIBALL_TICKS;
+  }
+
+  Multiball_Config config;
+  init_multiball_config(&config);
+  config.ball_cnt = ball_cnt;
+  config.ball_collisions = ball_collisions;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    static Multiball m;
+    if (!multiball_init(&m, &config, BENCH_SEED)) {
+      r->skipped = true;
+      return;
+    }
+    Rng input_rng;
+    rng_seed(&input_rng, BENCH_SEED);
+    Input input = 0;
+    uint64_t start = profile_now_ns();
+    for (int tick = 0; tick < MULTIBALL_TICKS; tick++) {
+      if (tick % 24 == 0)
+        input = rng_next(&input_rng) >> 60;
+      multiball_update(&m, input, TICK_DELTA);
+    }
+    double elapsed = profile_now_ns() - start;
+    r->samples[run] = elapsed / r->ops;
+    r->run_cnt++;
+    if (tests) {
+      tests->samples[run] = (double)m.stats.paddle_tests / MULTIBALL_TICKS;
+      tests->run_cnt++;
+    }
+    multiball_free(&m);
+  }
+}
+
+// Cost of building draw_game's draw commands. The window stays hidden and
+// only the draw_game calls are timed, not the flush in EndDrawing.
+static void bench_draw_game(Bench_Result *r) {
+  r->name = "draw_game";
+  r->unit = "ns/call";
+  r->ops = (uint64_t)DRAW_FRAMES * DRAW_CALLS_PER_FRAME;
+
+  // raylib exits the process when it can't open a window, so check first.
+  if (!getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY")) {
+    r->skipped = true;
+    return;
+  }
+  SetTraceLogLevel(LOG_WARNING);
+  SetConfigFlags(FLAG_WINDOW_HIDDEN);
+  InitWindow(800, 400, "pong bench");
+  if (!IsWindowReady()) {
+    r->skipped = true;
+    return;
+  }
+  SetTargetFPS(0);
+
+  Viewport viewport = {0};
+  viewport_update(&viewport);
+  State s;
+  init_state(&s, BENCH_SEED);
+  s.step = Step_Running;
+  s.pause = false;
+  s.left_player_score = 7;
+  s.right_player_score = 11;
+
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    double elapsed = 0;
+    for (int frame = 0; frame < DRAW_FRAMES; frame++) {
+      BeginDrawing();
+      ClearBackground(BLACK);
+      uint64_t start = profile_now_ns();
+      for (int i = 0; i < DRAW_CALLS_PER_FRAME; i++)
+        draw_game(&viewport, &s);
+      elapsed += profile_now_ns() - start;
+      EndDrawing();
+    }
+    r->samples[run] = elapsed / r->ops;
+  }
+  r->run_cnt = BENCH_RUNS;
+
+  CloseWindow();
+}
+
+static void write_result(FILE *f, const Bench_Result *r, bool last) {
+  if (r->skipped) {
+    fprintf(f, "    {\"name\": \"%s\", \"skipped\": true}%s\n", r->name,
+            last ? "" : ",");
+    return;
+  }
+
+  double sorted[BENCH_RUNS];
+  memcpy(sorted, r->samples, r->run_cnt * sizeof(double));
+  qsort(sorted, r->run_cnt, sizeof(double), compare_double);
+  fprintf(f,
+          "    {\"name\": \"%s\", \"unit\": \"%s\", \"median\": %.3f, "
+          "\"min\": %.3f, \"max\": %.3f, \"runs\": %d, \"ops\": %llu}%s\n",
+          r->name, r->unit, sorted[r->run_cnt / 2], sorted[0],
+          sorted[r->run_cnt - 1], r->run_cnt, (unsigned long long)r->ops,
+          last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+  const char *out_path = NULL;
+  bool render = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "--no-render") == 0) {
+      render = false;
+    } else {
+      fprintf(stderr, "usage: %s [--out FILE] [--no-render]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  Bench_Result results[13];
+  memset(results, 0, sizeof(results));
+  bench_physics(&results[0], &results[1]);
+  bench_batch(&results[2], false);
+  bench_batch(&results[3], true);
+  bench_ai(&results[4]);
+  bench_vec_env(&results[5]);
+  bench_snapshot(&results[6], &results[7]);
+  bench_multiball(&results[8], "multiball_10k", 10000, false, NULL);
+  bench_multiball(&results[9], "multiball_100k", 100000, false, &results[10]);
+  bench_multiball(&results[11], "multiball_10k_collide", 10000, true, NULL);
+  if (render) {
+    bench_draw_game(&results[12]);
+  } else {
+    results[12].name = "draw_game";
+    results[12].skipped = true;
+  }
+
+  FILE *f = out_path ? fopen(out_path, "w") : stdout;
+  if (!f) {
+    fprintf(stderr, "can't write %s\n", out_path);
+    return 1;
+  }
+  fprintf(f, "{\n  \"tick_rate\": %d,\n  \"kernel\": \"%s\",\n", TICK_RATE,
+          soa_kernel_name());
+  fprintf(f, "  \"results\": [\n");
+  int result_cnt = sizeof(results) / sizeof(results[0]);
+  for (int i = 0; i < result_cnt; i++)
+    write_result(f, &results[i], i == result_cnt - 1);
+  fprintf(f, "  ]\n}\n");
+  if (f != stdout)
+    fclose(f);
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include "broadcast.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "profile.h"
+
+#define TICK_NS (1000000000.0 / TICK_RATE)
+
+int broadcast_connect(const char *address) {
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  if (!colon || colon == address ||
+      (size_t)(colon - address) >= sizeof(host)) {
+    fprintf(stderr, "broadcast: %s is not HOST:PORT\n", address);
+    return -1;
+  }
+  memcpy(host, address, colon - address);
+  host[colon - address] = '\0';
+
+  struct addrinfo hints = {0};
+  struct addrinfo *info;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  int err = getaddrinfo(host, colon + 1, &hints, &info);
+  if (err != 0) {
+    fprintf(stderr, "broadcast: %s: %s\n", address, gai_strerror(err));
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+    fprintf(stderr, "broadcast: %s: %s\n", address, strerror(errno));
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(info);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+uint32_t broadcast_now_us(void) { return profile_now_ns() / 1000; }
+
+static int put_frame_header(uint8_t *p, Broadcast_Msg type, int len) {
+  p[0] = (len + 1) & 0xff;
+  p[1] = (len + 1) >> 8;
+  p[2] = type;
+  return BROADCAST_FRAME_HEADER;
+}
+
+static void flush_publisher(Publisher *p) {
+  int at = 0;
+  while (at < p->out_len) {
+    ssize_t n = send(p->fd, p->out + at, p->out_len - at,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN) {
+        fprintf(stderr, "broadcast: relay closed: %s\n", strerror(errno));
+        publisher_close(p);
+        return;
+      }
+      break;
+    }
+    at += n;
+  }
+  memmove(p->out, p->out + at, p->out_len - at);
+  p->out_len -= at;
+}
+
+bool publisher_open(Publisher *p, const char *address) {
+  memset(p, 0, sizeof(*p));
+  p->fd = broadcast_connect(address);
+  if (p->fd < 0)
+    return false;
+  p->out_len = put_frame_header(p->out, Broadcast_Msg_Publish, 1);
+  p->out[p->out_len++] = BROADCAST_VERSION;
+  flush_publisher(p);
+  return p->fd >= 0;
+}
+
+void publisher_send(Publisher *p, const State *s, uint32_t tick) {
+  if (p->fd < 0)
+    return;
+  flush_publisher(p);
+  if (p->fd < 0)
+    return;
+  if (p->out_len + BROADCAST_MAX_FRAME > BROADCAST_OUT_SIZE) {
+    p->dropped++;
+    return;
+  }
+
+  Snapshot cur;
+  snapshot_quantize(s, &cur);
+  bool keyframe = p->seq % BROADCAST_KEYFRAME_INTERVAL == 0;
+  uint8_t *frame = p->out + p->out_len;
+  uint8_t *at = frame + BROADCAST_FRAME_HEADER;
+  at = put_u32(at, tick);
+  at = put_u32(at, p->seq);
+  at = put_u32(at, broadcast_now_us());
+  *at++ = keyframe;
+  at += snapshot_encode(&cur, keyframe ? NULL : &p->prev, at);
+  int len = at - frame - BROADCAST_FRAME_HEADER;
+  put_frame_header(frame, Broadcast_Msg_Snapshot, len);
+  p->out_len += BROADCAST_FRAME_HEADER + len;
+  p->prev = cur;
+  p->seq++;
+  flush_publisher(p);
+}
+
+void publisher_close(Publisher *p) {
+  if (p->fd >= 0)
+    close(p->fd);
+  p->fd = -1;
+}
+
+bool watcher_open(Watcher *w, const char *address, int delay_ms) {
+  memset(w, 0, sizeof(*w));
+  w->delay_ticks = delay_ms * TICK_RATE / 1000.0f;
+  w->fd = broadcast_connect(address);
+  if (w->fd < 0)
+    return false;
+  uint8_t hello[BROADCAST_FRAME_HEADER + 1];
+  put_frame_header(hello, Broadcast_Msg_Watch, 1);
+  hello[BROADCAST_FRAME_HEADER] = BROADCAST_VERSION;
+  if (send(w->fd, hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+    watcher_close(w);
+    return false;
+  }
+  return true;
+}
+
+void watcher_push(Watcher *w, const uint8_t *payload, int len) {
+  if (len < BROADCAST_SNAPSHOT_HEADER)
+    return;
+  uint32_t tick, seq, stamp;
+  get_u32(payload, &tick);
+  get_u32(payload + 4, &seq);
+  get_u32(payload + 8, &stamp);
+  bool keyframe = payload[12];
+
+  const Snapshot *base = NULL;
+  if (!keyframe) {
+    if (!w->has_last || seq != w->last_seq + 1) {
+      // Wait for the next keyframe.
+      w->gaps++;
+      w->has_last = false;
+      return;
+    }
+    base = &w->last;
+  }
+  Snapshot decoded;
+  if (!snapshot_decode(payload + BROADCAST_SNAPSHOT_HEADER,
+                       len - BROADCAST_SNAPSHOT_HEADER, base, &decoded)) {
+    w->gaps++;
+    w->has_last = false;
+    return;
+  }
+  w->last = decoded;
+  w->last_seq = seq;
+  w->has_last = true;
+  w->received++;
+  w->last_stamp_us = stamp;
+
+  // A tick going backwards means the publisher started over.
+  if (w->buffered_cnt && tick <= w->buffered[w->buffered_cnt - 1].tick) {
+    w->buffered_cnt = 0;
+    w->playing = false;
+  }
+  if (w->buffered_cnt == BROADCAST_BUFFERED) {
+    memmove(w->buffered, w->buffered + 1,
+            (BROADCAST_BUFFERED - 1) * sizeof(w->buffered[0]));
+    w->buffered_cnt--;
+  }
+  Watched_State *ws = &w->buffered[w->buffered_cnt++];
+  ws->tick = tick;
+  snapshot_dequantize(&decoded, &ws->state);
+}
+
+bool watcher_poll(Watcher *w) {
+  if (w->fd < 0)
+    return false;
+  for (;;) {
+    ssize_t n = recv(w->fd, w->in + w->in_len, BROADCAST_IN_SIZE - w->in_len,
+                     MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      watcher_close(w);
+      return false;
+    }
+    if (n < 0)
+      return true;
+    w->in_len += n;
+
+    int at = 0;
+    while (w->in_len - at >= BROADCAST_FRAME_HEADER) {
+      int size = w->in[at] | w->in[at + 1] << 8;
+      if (size < 1 || size > BROADCAST_IN_SIZE - 2) {
+        watcher_close(w);
+        return false;
+      }
+      if (w->in_len - at < 2 + size)
+        break;
+      if (w->in[at + 2] == Broadcast_Msg_Snapshot)
+        watcher_push(w, w->in + at + BROADCAST_FRAME_HEADER, size - 1);
+      at += 2 + size;
+    }
+    memmove(w->in, w->in + at, w->in_len - at);
+    w->in_len -= at;
+  }
+}
+
+bool watcher_sample(Watcher *w, uint64_t now_ns, const State **prev,
+                    const State **cur, float *alpha) {
+  if (w->buffered_cnt == 0)
+    return false;
+  double oldest = w->buffered[0].tick;
+  double newest = w->buffered[w->buffered_cnt - 1].tick;
+  double target = newest - w->delay_ticks;
+  if (!w->playing) {
+    w->play_tick = target;
+    w->playing = true;
+  } else {
+    w->play_tick += (now_ns - w->last_sample_ns) / TICK_NS;
+  }
+  w->last_sample_ns = now_ns;
+  // Hold on the newest snapshot while the stream stalls, and catch up in
+  // one jump when a burst leaves playback far behind.
+  if (w->play_tick > newest)
+    w->play_tick = newest;
+  if (w->play_tick < target - w->delay_ticks)
+    w->play_tick = target;
+  if (w->play_tick < oldest)
+    w->play_tick = oldest;
+
+  int i = 0;
+  while (i + 1 < w->buffered_cnt && w->buffered[i + 1].tick <= w->play_tick)
+    i++;
+  *prev = &w->buffered[i].state;
+  if (i + 1 == w->buffered_cnt) {
+    *cur = *prev;
+    *alpha = 0;
+    return true;
+  }
+  *cur = &w->buffered[i + 1].state;
+  *alpha = (w->play_tick - w->buffered[i].tick) /
+           (w->buffered[i + 1].tick - w->buffered[i].tick);
+  return true;
+}
+
+void watcher_close(Watcher *w) {
+  if (w->fd >= 0)
+    close(w->fd);
+  w->fd = -1;
+}
@@ -0,0 +1,96 @@
+#ifndef PONG_BROADCAST_H
+#define PONG_BROADCAST_H
+
+// Spectator stream of one match. A Publisher (the game, or loadgen) sends
+// snapshot.h snapshots at BROADCAST_EVERY ticks to a relay, which fans the
+// bytes out to viewers as they are, and a Watcher on each viewer buffers
+// them and plays them back a fixed delay behind, interpolating in between.
+//
+// Frames are a little-endian u16 length of what follows, a u8 Broadcast_Msg
+// and the payload, like server_proto.h. Every snapshot is a delta against
+// the one before it, except every BROADCAST_KEYFRAME_INTERVAL-th, so a
+// viewer can start from the last keyframe and the relay never re-encodes.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+#include "snapshot.h"
+
+#define BROADCAST_VERSION 1
+#define BROADCAST_DEFAULT_PORT 7800
+#define BROADCAST_FRAME_HEADER 3
+#define BROADCAST_SNAPSHOT_HEADER 13
+#define BROADCAST_MAX_FRAME                                                    \
+  (BROADCAST_FRAME_HEADER + BROADCAST_SNAPSHOT_HEADER + SNAPSHOT_MAX_SIZE)
+#define BROADCAST_EVERY 4                // ticks between snapshots, 60 Hz
+#define BROADCAST_KEYFRAME_INTERVAL 60   // snapshots, once a second
+#define BROADCAST_OUT_SIZE 4096
+#define BROADCAST_IN_SIZE 4096
+#define BROADCAST_BUFFERED 64 // snapshots a Watcher keeps, about a second
+
+typedef enum {
+  Broadcast_Msg_Publish = 1, // u8 version; the connection is a source
+  Broadcast_Msg_Watch = 2,   // u8 version; the connection is a viewer
+  // u32 tick, u32 sequence, u32 publisher clock in us, u8 keyframe,
+  // snapshot_encode bytes against the previous sequence
+  Broadcast_Msg_Snapshot = 3,
+} Broadcast_Msg;
+
+typedef struct {
+  int fd;
+  uint32_t seq;
+  Snapshot prev; // the last one sent, baseline of the next
+  uint8_t out[BROADCAST_OUT_SIZE];
+  int out_len;
+  uint64_t dropped;
+} Publisher;
+
+typedef struct {
+  uint32_t tick;
+  State state;
+} Watched_State;
+
+typedef struct {
+  int fd;
+  uint8_t in[BROADCAST_IN_SIZE];
+  int in_len;
+  Snapshot last;
+  uint32_t last_seq;
+  bool has_last;
+  // Decoded snapshots, oldest first, by tick.
+  Watched_State buffered[BROADCAST_BUFFERED];
+  int buffered_cnt;
+  // Playback clock in ticks, delay_ticks behind the newest snapshot.
+  float delay_ticks;
+  double play_tick;
+  uint64_t last_sample_ns;
+  bool playing;
+  uint64_t received;
+  uint64_t gaps; // deltas without their baseline, skipped to a keyframe
+  uint32_t last_stamp_us;
+} Watcher;
+
+// Blocking connect to HOST:PORT, then non-blocking. Prints why on failure.
+int broadcast_connect(const char *address);
+uint32_t broadcast_now_us(void);
+
+bool publisher_open(Publisher *p, const char *address);
+// Sends a snapshot of `s`; call every BROADCAST_EVERY ticks. A frame that
+// doesn't fit the socket is dropped and the next one is coded against the
+// last one that went out, so the stream stays decodable.
+void publisher_send(Publisher *p, const State *s, uint32_t tick);
+void publisher_close(Publisher *p);
+
+bool watcher_open(Watcher *w, const char *address, int delay_ms);
+// Reads what arrived. Returns false once the stream is closed.
+bool watcher_poll(Watcher *w);
+// Feeds one Broadcast_Msg_Snapshot payload, for callers doing their own IO.
+void watcher_push(Watcher *w, const uint8_t *payload, int len);
+// Advances the playback clock to now and picks the two snapshots around it.
+// Returns false while nothing is buffered yet.
+bool watcher_sample(Watcher *w, uint64_t now_ns, const State **prev,
+                    const State **cur, float *alpha);
+void watcher_close(Watcher *w);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef PONG_BYTES_H
+#define PONG_BYTES_H
+
+// Little-endian field encoding for the on-disk and on-wire formats. Each
+// helper returns the position right after what it wrote or read.
+
+#include <stdint.h>
+#include <string.h>
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    *p++ = v >> (8 * i);
+  return p;
+}
+
+static inline uint8_t *put_u64(uint8_t *p, uint64_t v) {
+  for (int i = 0; i < 8; i++)
+    *p++ = v >> (8 * i);
+  return p;
+}
+
+static inline uint8_t *put_f32(uint8_t *p, float f) {
+  uint32_t v;
+  memcpy(&v, &f, sizeof(v));
+  return put_u32(p, v);
+}
+
+static inline const uint8_t *get_u32(const uint8_t *p, uint32_t *v) {
+  *v = 0;
+  for (int i = 0; i < 4; i++)
+    *v |= (uint32_t)*p++ << (8 * i);
+  return p;
+}
+
+static inline const uint8_t *get_u64(const uint8_t *p, uint64_t *v) {
+  *v = 0;
+  for (int i = 0; i < 8; i++)
+    *v |= (uint64_t)*p++ << (8 * i);
+  return p;
+}
+
+static inline const uint8_t *get_f32(const uint8_t *p, float *f) {
+  uint32_t v;
+  p = get_u32(p, &v);
+  memcpy(f, &v, sizeof(v));
+  return p;
+}
+
+#endif
@@ -0,0 +1,405 @@
+#include "draw.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+#define OVERLAY_FRAMES 240
+#define OVERLAY_GRAPH_HEIGHT 80
+#define OVERLAY_GRAPH_SCALE_MS 33.3 // full graph height
+
+void viewport_update(Viewport *v) {
+  if (v->valid && !IsWindowResized())
+    return;
+
+  int width = GetScreenWidth();
+  int height = GetScreenHeight();
+  // A minimized window can report a zero height; keep the last good size.
+  if (width <= 0 || height <= 0)
+    return;
+
+  v->width = width;
+  v->height = height;
+  v->aspect_ratio = (float)width / (float)height;
+  v->valid = true;
+}
+
+Rectangle get_real_paddle_dimentions(const Viewport *v, Paddle *p) {
+  Rectangle r;
+  r.x = p->x * v->width;
+  r.y = p->y * v->height;
+  r.width = p->w * v->width;
+  r.height = p->h * v->height;
+  return r;
+}
+
+Rectangle get_real_ball_rect(const Viewport *v, Ball *b) {
+  Rectangle r;
+  r.x = b->x * v->width;
+  r.y = b->y * v->height;
+  r.width = BALL_SIZE * v->width;
+  r.height = BALL_SIZE * v->width;
+  return r;
+}
+
+static float lerp_float(float a, float b, float t) {
+  return a + (b - a) * t;
+}
+
+static Paddle interpolate_paddle(Paddle *prev, Paddle *cur, float alpha) {
+  Paddle p = *cur;
+  p.x = lerp_float(prev->x, cur->x, alpha);
+  p.y = lerp_float(prev->y, cur->y, alpha);
+  return p;
+}
+
+// Blends positions between the last two ticks. Transitions that teleport the
+// ball (a point scored, a restart) are drawn at the new tick as is.
+State interpolate_state(State *prev, State *cur, float alpha) {
+  State s = *cur;
+  if (prev->step != cur->step || prev->pause != cur->pause ||
+      prev->left_player_score != cur->left_player_score ||
+      prev->right_player_score != cur->right_player_score)
+    return s;
+
+  s.ball.x = lerp_float(prev->ball.x, cur->ball.x, alpha);
+  s.ball.y = lerp_float(prev->ball.y, cur->ball.y, alpha);
+  s.left_paddle =
+      interpolate_paddle(&prev->left_paddle, &cur->left_paddle, alpha);
+  s.right_paddle =
+      interpolate_paddle(&prev->right_paddle, &cur->right_paddle, alpha);
+  return s;
+}
+
+// HUD text is drawn from an atlas rendered once with the default font:
+// digits, ' ', ':' and the "Paused" label. Strings are only re-formatted and
+// re-measured when the value behind them changes.
+#define HUD_FPS_BUCKET 5
+#define HUD_SPACING (FONT_SIZE / 10) // what DrawText puts between glyphs
+
+typedef enum {
+  Hud_Glyph_Space = 10,
+  Hud_Glyph_Colon,
+  Hud_Glyph_Paused,
+  Hud_Glyph_Cnt,
+} Hud_Glyph;
+
+static const char *hud_glyph_text[Hud_Glyph_Cnt] = {
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", " ", ":", "Paused",
+};
+
+typedef struct {
+  RenderTexture2D texture;
+  Rectangle glyphs[Hud_Glyph_Cnt];
+  bool loaded;
+} Hud_Atlas;
+
+typedef struct {
+  int a;
+  int b;
+  char text[32]; // "%d : %d" fits any two ints
+  float width;
+  bool valid;
+} Hud_Text;
+
+static Hud_Atlas hud_atlas;
+static Hud_Text hud_fps;
+static Hud_Text hud_score;
+
+// Needs a GL context, so it happens on the first draw rather than at init.
+static void load_hud_atlas(void) {
+  float width = 0;
+  for (int i = 0; i < Hud_Glyph_Cnt; i++) {
+    Rectangle *g = &hud_atlas.glyphs[i];
+    g->x = width;
+    g->y = 0;
+    g->width = MeasureText(hud_glyph_text[i], FONT_SIZE);
+    g->height = FONT_SIZE;
+    width += g->width + HUD_SPACING;
+  }
+
+  hud_atlas.texture = LoadRenderTexture(width, FONT_SIZE);
+  BeginTextureMode(hud_atlas.texture);
+  ClearBackground(BLANK);
+  for (int i = 0; i < Hud_Glyph_Cnt; i++)
+    DrawText(hud_glyph_text[i], hud_atlas.glyphs[i].x, 0, FONT_SIZE, WHITE);
+  EndTextureMode();
+  hud_atlas.loaded = true;
+}
+
+static Hud_Glyph hud_glyph_index(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c == ':')
+    return Hud_Glyph_Colon;
+  return Hud_Glyph_Space; // scores and FPS are never negative
+}
+
+static void draw_hud_glyph(Hud_Glyph glyph, float x, float y, Color tint) {
+  Rectangle src = hud_atlas.glyphs[glyph];
+  src.height = -src.height; // render textures are stored upside down
+  DrawTextureRec(hud_atlas.texture.texture, src, (Vector2){x, y}, tint);
+}
+
+// Re-formats `t` if the values changed. b < 0 means a single value.
+static void update_hud_text(Hud_Text *t, int a, int b) {
+  if (t->valid && t->a == a && t->b == b)
+    return;
+
+  if (b < 0)
+    snprintf(t->text, sizeof(t->text), "%d", a);
+  else
+    snprintf(t->text, sizeof(t->text), "%d : %d", a, b);
+
+  t->width = 0;
+  for (const char *c = t->text; *c; c++)
+    t->width += hud_atlas.glyphs[hud_glyph_index(*c)].width + HUD_SPACING;
+  if (t->width > 0)
+    t->width -= HUD_SPACING;
+  t->a = a;
+  t->b = b;
+  t->valid = true;
+}
+
+static void draw_hud_text(Hud_Text *t, float x, float y, Color tint) {
+  for (const char *c = t->text; *c; c++) {
+    Hud_Glyph glyph = hud_glyph_index(*c);
+    draw_hud_glyph(glyph, x, y, tint);
+    x += hud_atlas.glyphs[glyph].width + HUD_SPACING;
+  }
+}
+
+// Everything draw_game draws but the ball.
+static void draw_field(const Viewport *v, State *s) {
+  if (!hud_atlas.loaded)
+    load_hud_atlas();
+
+  if (s->pause) {
+    float len = hud_atlas.glyphs[Hud_Glyph_Paused].width;
+    draw_hud_glyph(Hud_Glyph_Paused, v->width - len - FONT_SIZE, FONT_SIZE,
+                   WHITE);
+  }
+
+  Rectangle left_paddle_rect = get_real_paddle_dimentions(v, &s->left_paddle);
+  Rectangle right_paddle_rect =
+      get_real_paddle_dimentions(v, &s->right_paddle);
+
+  DrawRectangleRec(left_paddle_rect, RAYWHITE);
+  DrawRectangleRec(right_paddle_rect, RAYWHITE);
+
+  int fps = GetFPS();
+  update_hud_text(&hud_fps, fps - fps % HUD_FPS_BUCKET, -1);
+  draw_hud_text(&hud_fps, 0, 0, RAYWHITE);
+
+  update_hud_text(&hud_score, s->left_player_score, s->right_player_score);
+  draw_hud_text(&hud_score, (int)(v->width / 2 - hud_score.width / 2), 17,
+                RAYWHITE);
+}
+
+void draw_game(const Viewport *v, State *s) {
+  draw_field(v, s);
+  Rectangle ball_rect = get_real_ball_rect(v, &s->ball);
+  DrawRectangleRec(ball_rect, RAYWHITE);
+}
+
+void draw_multiball(const Viewport *v, Multiball *m, float alpha) {
+  draw_field(v, &m->state);
+  const Ball_Pool *p = &m->balls;
+  float back = m->state.pause ? 0 : (1 - alpha) * TICK_DELTA;
+  float back_x = back * m->state.aspect_ratio * v->width;
+  float back_y = back * v->height;
+  float size = BALL_SIZE * v->width;
+  for (int i = 0; i < p->count; i++)
+    DrawRectangleRec((Rectangle){p->x[i] * v->width - p->vx[i] * back_x,
+                                 p->y[i] * v->height - p->vy[i] * back_y,
+                                 size, size},
+                     RAYWHITE);
+}
+
+// Menu panels are rendered into a texture and blitted as one quad. The
+// texture is redrawn only when the selection or the window size changes.
+#define PANEL_SIZE (FONT_SIZE * 10 + UI_PADDING * 2)
+
+typedef struct {
+  RenderTexture2D texture;
+  int selected_item;
+  int screen_w;
+  int screen_h;
+  bool loaded;
+} Panel_Cache;
+
+static Panel_Cache main_menu_panel;
+static Panel_Cache win_screen_panel;
+
+static const char *main_menu_labels[Main_Menu_Item_Cnt] = {
+    [Main_Menu_Item_Start_Coop] = "Start Coop Game",
+    [Main_Menu_Item_Start_Solo] = "Start Solo Game",
+    [Main_Menu_Item_Exit] = "Exit",
+};
+
+static const char *win_screen_labels[Win_Screen_Item_Cnt] = {
+    [Win_Screen_Item_Restart] = "Restart",
+    [Win_Screen_Item_Main_Menu] = "Main Menu",
+};
+
+static void draw_panel(const Viewport *v, Panel_Cache *p, const char **labels,
+                       int label_cnt, int selected_item, Vector2 pos) {
+  if (!p->loaded) {
+    p->texture = LoadRenderTexture(PANEL_SIZE, PANEL_SIZE);
+    p->loaded = true;
+    p->selected_item = -1;
+  }
+
+  if (p->selected_item != selected_item || p->screen_w != v->width ||
+      p->screen_h != v->height) {
+    BeginTextureMode(p->texture);
+    ClearBackground(GRAY);
+    float y_offset = FONT_SIZE + UI_PADDING;
+    for (int i = 0; i < label_cnt; i++)
+      DrawText(labels[i], UI_PADDING, UI_PADDING + i * y_offset, FONT_SIZE,
+               i == selected_item ? RAYWHITE : BLACK);
+    EndTextureMode();
+    p->selected_item = selected_item;
+    p->screen_w = v->width;
+    p->screen_h = v->height;
+  }
+
+  Rectangle src = {0, 0, PANEL_SIZE, -PANEL_SIZE}; // stored upside down
+  DrawTextureRec(p->texture.texture, src, pos, WHITE);
+}
+
+void draw_main_menu(const Viewport *v, State *s) {
+  Vector2 pos = {v->width / 2.0f - PANEL_SIZE / 2.0f,
+                 v->height / 2.0f - PANEL_SIZE / 2.0f};
+  draw_panel(v, &main_menu_panel, main_menu_labels, Main_Menu_Item_Cnt,
+             s->main_menu.selected_item, pos);
+}
+
+void draw_win_screen(const Viewport *v, State *s) {
+  Vector2 pos = {v->width / 2.0f - PANEL_SIZE / 2.0f,
+                 v->height - PANEL_SIZE};
+  draw_panel(v, &win_screen_panel, win_screen_labels, Win_Screen_Item_Cnt,
+             s->win_screen.selected_item, pos);
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Frame-time overlay over the last OVERLAY_FRAMES published frames: p50, p99
+// and max frame time, jitter, average time per zone and a frame-time graph.
+void draw_profile_overlay(const Pacer *pacer) {
+  static Profile_Frame frame;
+  uint64_t frame_ns[OVERLAY_FRAMES];
+  uint64_t sorted_ns[OVERLAY_FRAMES];
+  uint64_t zone_ns[Profile_Zone_Cnt] = {0};
+  int frame_cnt = 0;
+
+  uint64_t head = atomic_load(&profile_ring.head);
+  uint64_t first = head > OVERLAY_FRAMES ? head - OVERLAY_FRAMES : 0;
+  for (uint64_t i = first; i < head; i++) {
+    if (!profile_read_frame(i, &frame))
+      continue;
+    frame_ns[frame_cnt++] = frame.zone_ns[Profile_Zone_Frame];
+    for (int z = 0; z < Profile_Zone_Cnt; z++)
+      zone_ns[z] += frame.zone_ns[z];
+  }
+  if (frame_cnt == 0)
+    return;
+
+  memcpy(sorted_ns, frame_ns, frame_cnt * sizeof(uint64_t));
+  qsort(sorted_ns, frame_cnt, sizeof(uint64_t), compare_u64);
+  double p50 = sorted_ns[frame_cnt / 2] / 1e6;
+  double p99 = sorted_ns[(frame_cnt * 99) / 100] / 1e6;
+  double max = sorted_ns[frame_cnt - 1] / 1e6;
+
+  double mean = 0, variance = 0;
+  for (int i = 0; i < frame_cnt; i++)
+    mean += frame_ns[i] / 1e6;
+  mean /= frame_cnt;
+  for (int i = 0; i < frame_cnt; i++)
+    variance += (frame_ns[i] / 1e6 - mean) * (frame_ns[i] / 1e6 - mean);
+  double jitter = frame_cnt > 1 ? sqrt(variance / (frame_cnt - 1)) : 0.0;
+
+  int font = FONT_SIZE / 2;
+  int x = UI_PADDING;
+  int y = FONT_SIZE + UI_PADDING;
+  char line[64];
+
+  DrawRectangle(0, y - UI_PADDING / 2,
+                OVERLAY_FRAMES * 2 + UI_PADDING * 2,
+                (Profile_Zone_Cnt + 2) * font + OVERLAY_GRAPH_HEIGHT +
+                    UI_PADDING * 2,
+                Fade(BLACK, 0.7));
+
+  snprintf(line, sizeof(line), "p50 %.2fms  p99 %.2fms  max %.2fms", p50, p99,
+           max);
+  DrawText(line, x, y, font, GREEN);
+  y += font;
+  if (pacer->config.target_fps > 0)
+    snprintf(line, sizeof(line), "%s %dfps  jitter %.3fms",
+             limiter_names[pacer->config.limiter], pacer->config.target_fps,
+             jitter);
+  else
+    snprintf(line, sizeof(line), "%s  jitter %.3fms",
+             limiter_names[pacer->config.limiter], jitter);
+  DrawText(line, x, y, font, GREEN);
+  y += font;
+  for (int z = Profile_Zone_Input; z < Profile_Zone_Cnt; z++) {
+    snprintf(line, sizeof(line), "%-12s %.3fms", profile_zone_names[z],
+             zone_ns[z] / 1e6 / frame_cnt);
+    DrawText(line, x, y, font, RAYWHITE);
+    y += font;
+  }
+
+  y += UI_PADDING;
+  int bottom = y + OVERLAY_GRAPH_HEIGHT;
+  DrawLine(x, bottom, x + OVERLAY_FRAMES * 2, bottom, GRAY);
+  for (int i = 0; i < frame_cnt; i++) {
+    double ms = frame_ns[i] / 1e6;
+    int h = ms / OVERLAY_GRAPH_SCALE_MS * OVERLAY_GRAPH_HEIGHT;
+    if (h > OVERLAY_GRAPH_HEIGHT)
+      h = OVERLAY_GRAPH_HEIGHT;
+    Color c = ms > p99 ? RED : ms > p50 * 2 ? YELLOW : GREEN;
+    DrawRectangle(x + i * 2, bottom - h, 2, h, c);
+  }
+}
+
+void draw_letterboxed(const Viewport *window, State *s) {
+  Viewport field = *window;
+  if (window->aspect_ratio > s->aspect_ratio)
+    field.width = (int)(window->height * s->aspect_ratio);
+  else
+    field.height = (int)(window->width / s->aspect_ratio);
+  field.aspect_ratio = s->aspect_ratio;
+  Vector2 origin = {(window->width - field.width) / 2,
+                    (window->height - field.height) / 2};
+
+  DrawRectangleLines(origin.x - 1, origin.y - 1, field.width + 2,
+                     field.height + 2, DARKGRAY);
+  Camera2D camera = {.offset = origin, .zoom = 1.0f};
+  BeginScissorMode(origin.x, origin.y, field.width, field.height);
+  BeginMode2D(camera);
+  draw(&field, s);
+  EndMode2D();
+  EndScissorMode();
+}
+
+void draw(const Viewport *v, State *s) {
+  uint64_t t = profile_begin();
+  if (s->step == Step_Main_Menu) {
+    draw_main_menu(v, s);
+    profile_end(Profile_Zone_Draw_Main_Menu, t);
+  } else if (s->step == Step_Win_Screen) {
+    draw_win_screen(v, s);
+    profile_end(Profile_Zone_Draw_Win_Screen, t);
+  } else {
+    draw_game(v, s);
+    profile_end(Profile_Zone_Draw_Game, t);
+  }
+}
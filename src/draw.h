@@ -0,0 +1,46 @@
+#ifndef PONG_DRAW_H
+#define PONG_DRAW_H
+
+// raylib rendering of a State. Call between BeginDrawing and EndDrawing.
+
+#include <raylib.h>
+
+#include "multiball.h"
+#include "pacing.h"
+#include "sim.h"
+
+#define FONT_SIZE 36
+#define UI_PADDING 8
+
+// Window size and the world-to-pixel transform for the current frame. World
+// coordinates are fractions of the screen, so the transform is a scale.
+typedef struct {
+  int width;
+  int height;
+  float aspect_ratio; // width / height, what the sim sees
+  bool valid;
+} Viewport;
+
+// Re-reads the window size on the first call and after a resize.
+void viewport_update(Viewport *v);
+
+Rectangle get_real_paddle_dimentions(const Viewport *v, Paddle *p);
+Rectangle get_real_ball_rect(const Viewport *v, Ball *b);
+
+// Blends positions between the last two ticks for drawing.
+State interpolate_state(State *prev, State *cur, float alpha);
+
+void draw_game(const Viewport *v, State *s);
+// Balls are drawn (1 - alpha) of a tick back along their velocity, which is
+// where interpolating from the last tick would put them unless they bounced.
+void draw_multiball(const Viewport *v, Multiball *m, float alpha);
+void draw_main_menu(const Viewport *v, State *s);
+void draw_win_screen(const Viewport *v, State *s);
+void draw_profile_overlay(const Pacer *pacer);
+void draw(const Viewport *v, State *s);
+// draw for a state whose aspect ratio isn't the window's, such as a netplay
+// match both peers simulate at the same one: the largest centred part of the
+// window with s->aspect_ratio, outlined, with black bars around it.
+void draw_letterboxed(const Viewport *window, State *s);
+
+#endif
@@ -0,0 +1,78 @@
+#include "input.h"
+
+#include <raylib.h>
+#include <string.h>
+
+#include "profile.h"
+
+// From the GLFW copy built into raylib. raylib's key callback writes the
+// current key state directly; the previous state used for IsKeyPressed is
+// only rotated in EndDrawing, so extra polls don't eat edges.
+void glfwPollEvents(void);
+
+static const int sampler_keys[INPUT_SAMPLER_KEYS] = {KEY_W, KEY_S, KEY_UP,
+                                                     KEY_DOWN};
+static const Input_Bit sampler_bits[INPUT_SAMPLER_KEYS] = {
+    Input_Left_Up, Input_Left_Down, Input_Right_Up, Input_Right_Down};
+
+void input_sampler_init(Input_Sampler *s) {
+  memset(s, 0, sizeof(*s));
+  s->last_poll_ns = profile_now_ns();
+}
+
+void input_sampler_poll(Input_Sampler *s) {
+  glfwPollEvents();
+  uint64_t now = profile_now_ns();
+  // The transition happened somewhere since the last poll; the midpoint
+  // halves the worst-case error.
+  uint64_t at = s->last_poll_ns + (now - s->last_poll_ns) / 2;
+
+  for (int k = 0; k < INPUT_SAMPLER_KEYS; k++) {
+    bool down = IsKeyDown(sampler_keys[k]);
+    if (down == s->polled_down[k])
+      continue;
+    s->polled_down[k] = down;
+    // A full queue keeps its last slot for the newest state.
+    int i = s->event_cnt[k] < INPUT_SAMPLER_EVENTS ? s->event_cnt[k]++
+                                                   : INPUT_SAMPLER_EVENTS - 1;
+    s->events[k][i] = (Key_Event){at, down};
+  }
+  s->last_poll_ns = now;
+}
+
+Input input_sampler_tick(Input_Sampler *s, uint64_t begin_ns,
+                         uint64_t end_ns) {
+  Input input = 0;
+  s->press_ns = 0;
+  if (end_ns <= begin_ns)
+    return input;
+
+  for (int k = 0; k < INPUT_SAMPLER_KEYS; k++) {
+    bool down = s->tick_down[k];
+    uint64_t t = begin_ns;
+    uint64_t held = 0;
+    int used = 0;
+    for (; used < s->event_cnt[k]; used++) {
+      Key_Event *e = &s->events[k][used];
+      if (e->ns >= end_ns)
+        break;
+      uint64_t at = e->ns > t ? e->ns : t;
+      if (down)
+        held += at - t;
+      t = at;
+      down = e->down;
+      if (down && (s->press_ns == 0 || e->ns < s->press_ns))
+        s->press_ns = e->ns;
+    }
+    if (down)
+      held += end_ns - t;
+
+    s->tick_down[k] = down;
+    s->event_cnt[k] -= used;
+    memmove(s->events[k], s->events[k] + used,
+            s->event_cnt[k] * sizeof(Key_Event));
+    input = input_set_hold(input, sampler_bits[k],
+                           (float)held / (end_ns - begin_ns));
+  }
+  return input;
+}
@@ -0,0 +1,40 @@
+#ifndef PONG_INPUT_H
+#define PONG_INPUT_H
+
+// Paddle key sampling between frames. raylib only polls the OS in
+// EndDrawing, so a key pressed early in a frame used to wait for the next
+// frame and then count as held for whole ticks. The sampler polls before
+// every tick, timestamps each transition, and turns the key timeline into
+// partial holds (INPUT_HOLD_*) for the real-time window each tick covers.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+#define INPUT_SAMPLER_KEYS 4
+#define INPUT_SAMPLER_EVENTS 16 // pending transitions per key
+
+typedef struct {
+  uint64_t ns;
+  bool down;
+} Key_Event;
+
+typedef struct {
+  bool polled_down[INPUT_SAMPLER_KEYS]; // as of the last poll
+  bool tick_down[INPUT_SAMPLER_KEYS];   // as of the end of the last tick
+  Key_Event events[INPUT_SAMPLER_KEYS][INPUT_SAMPLER_EVENTS];
+  int event_cnt[INPUT_SAMPLER_KEYS];
+  uint64_t last_poll_ns;
+  uint64_t press_ns; // earliest key press the last tick consumed, 0 if none
+} Input_Sampler;
+
+void input_sampler_init(Input_Sampler *s);
+// Pumps OS events and records paddle key transitions. Safe to call any
+// number of times per frame; IsKeyPressed still sees one edge per frame.
+void input_sampler_poll(Input_Sampler *s);
+// Paddle bits with partial holds for the tick covering [begin_ns, end_ns).
+// Consumes the transitions up to end_ns.
+Input input_sampler_tick(Input_Sampler *s, uint64_t begin_ns, uint64_t end_ns);
+
+#endif
@@ -0,0 +1,90 @@
+#include "latency.h"
+
+#include <string.h>
+
+#define LATENCY_BAR_WIDTH 50
+
+void latency_probe_init(Latency_Probe *p) { memset(p, 0, sizeof(*p)); }
+
+void latency_probe_input(Latency_Probe *p, uint64_t press_ns) {
+  // Several presses before one present all land in that frame; the oldest
+  // one is the latency the player feels.
+  if (p->pending_ns == 0 || press_ns < p->pending_ns)
+    p->pending_ns = press_ns;
+}
+
+void latency_probe_presented(Latency_Probe *p, uint64_t now_ns) {
+  if (p->pending_ns == 0)
+    return;
+
+  uint64_t latency = now_ns > p->pending_ns ? now_ns - p->pending_ns : 0;
+  uint64_t bucket = latency / 1000 / LATENCY_BUCKET_US;
+  if (bucket >= LATENCY_BUCKETS)
+    bucket = LATENCY_BUCKETS - 1;
+  p->buckets[bucket]++;
+  p->sample_cnt++;
+  if (latency > p->max_ns)
+    p->max_ns = latency;
+  p->pending_ns = 0;
+}
+
+double latency_probe_percentile(const Latency_Probe *p, double percentile) {
+  if (p->sample_cnt == 0)
+    return 0.0;
+
+  uint64_t rank = (uint64_t)(p->sample_cnt * percentile / 100.0);
+  uint64_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += p->buckets[i];
+    if (seen > rank)
+      return (i + 1) * LATENCY_BUCKET_US / 1000.0;
+  }
+  return LATENCY_BUCKETS * LATENCY_BUCKET_US / 1000.0;
+}
+
+void latency_probe_print(const Latency_Probe *p, const Pacing_Config *c,
+                         FILE *f) {
+  fprintf(f, "latency (%s", limiter_names[c->limiter]);
+  if (c->target_fps > 0)
+    fprintf(f, " %dfps", c->target_fps);
+  fprintf(f,
+          ", idle %s): %llu presses, p50 <%.2fms, p90 <%.2fms, "
+          "p99 <%.2fms, max %.2fms\n",
+          idle_mode_names[c->idle_mode], (unsigned long long)p->sample_cnt,
+          latency_probe_percentile(p, 50), latency_probe_percentile(p, 90),
+          latency_probe_percentile(p, 99), p->max_ns / 1e6);
+
+  uint64_t peak = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++)
+    if (p->buckets[i] > peak)
+      peak = p->buckets[i];
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    if (p->buckets[i] == 0)
+      continue;
+    char bar[LATENCY_BAR_WIDTH + 1];
+    int len = p->buckets[i] * LATENCY_BAR_WIDTH / peak;
+    memset(bar, '#', len);
+    bar[len] = '\0';
+    fprintf(f, "  %6.2fms %6llu %s\n", i * LATENCY_BUCKET_US / 1000.0,
+            (unsigned long long)p->buckets[i], bar);
+  }
+}
+
+bool latency_probe_append_csv(const Latency_Probe *p, const Pacing_Config *c,
+                              const char *path) {
+  FILE *f = fopen(path, "a");
+  if (!f)
+    return false;
+  if (ftell(f) == 0)
+    fprintf(f, "limiter,fps,idle,bucket_ms,count\n");
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    if (p->buckets[i] == 0)
+      continue;
+    fprintf(f, "%s,%d,%s,%.2f,%llu\n", limiter_names[c->limiter],
+            c->target_fps, idle_mode_names[c->idle_mode],
+            i * LATENCY_BUCKET_US / 1000.0,
+            (unsigned long long)p->buckets[i]);
+  }
+  fclose(f);
+  return true;
+}
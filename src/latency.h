@@ -0,0 +1,42 @@
+#ifndef PONG_LATENCY_H
+#define PONG_LATENCY_H
+
+// Input-to-present latency probe. A paddle key press is stamped when the
+// sampler sees it, and the latency is taken when EndDrawing returns for the
+// first frame drawn after the tick that consumed it. Results go into a
+// histogram labelled with the pacing configuration, so runs with different
+// --limiter/--fps/--idle settings can be compared.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pacing.h"
+
+#define LATENCY_BUCKET_US 250
+#define LATENCY_BUCKETS 200 // 50ms, slower samples land in the last bucket
+
+typedef struct {
+  uint64_t pending_ns; // press consumed by a tick but not presented yet
+  uint64_t buckets[LATENCY_BUCKETS];
+  uint64_t sample_cnt;
+  uint64_t max_ns;
+} Latency_Probe;
+
+void latency_probe_init(Latency_Probe *p);
+// A tick consumed a press that happened at press_ns.
+void latency_probe_input(Latency_Probe *p, uint64_t press_ns);
+// A frame was just presented at now_ns.
+void latency_probe_presented(Latency_Probe *p, uint64_t now_ns);
+// Latency in ms below which `percentile` of the samples fall.
+double latency_probe_percentile(const Latency_Probe *p, double percentile);
+
+// Prints a summary with a text histogram.
+void latency_probe_print(const Latency_Probe *p, const Pacing_Config *c,
+                         FILE *f);
+// Appends CSV rows (limiter,fps,idle,bucket_ms,count) to path, writing the
+// header if the file is new.
+bool latency_probe_append_csv(const Latency_Probe *p, const Pacing_Config *c,
+                              const char *path);
+
+#endif
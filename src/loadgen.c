@@ -0,0 +1,604 @@
+// Load generator for pong_server. Opens one connection per vs-AI match (two
+// per match with --versus), plays random keys at --input-hz and measures
+// how long an input takes to come back in a State message.
+//
+//   loadgen [--host ADDR] [--port N] [--matches N] [--versus]
+//           [--seconds N] [--input-hz N]
+//
+// With --relay it loads pong_relay instead: --viewers spectators decode the
+// broadcast.h stream and time each snapshot from publisher to viewer, and
+// --publish also plays an AI match and streams it as the publisher.
+//
+//   loadgen --relay [--host ADDR] [--port N] [--viewers N] [--publish]
+//           [--seconds N]
+//
+// Prints one line per second and a summary with percentiles.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "broadcast.h"
+#include "bytes.h"
+#include "profile.h"
+#include "server_proto.h"
+#include "sim.h"
+#include "snapshot.h"
+
+#define MAX_EVENTS 512
+#define IN_SIZE 1024
+#define RTT_BUCKET_US 100
+#define RTT_BUCKETS 2000 // up to 200ms, the last bucket takes the rest
+#define CONNECTS_PER_LOOP 256
+
+typedef struct {
+  int fd;
+  bool welcomed;
+  uint8_t keys;
+  uint64_t next_input_ns;
+  uint32_t pending_stamp; // the stamp last sent, 0 once it came back
+  Snapshot history[SERVER_SNAPSHOT_HISTORY];
+  uint32_t history_seq[SERVER_SNAPSHOT_HISTORY]; // sequence + 1 per entry
+  uint32_t acked; // newest sequence decoded + 1, sent with every input
+  uint8_t in[IN_SIZE];
+  int in_len;
+} Client;
+
+typedef struct {
+  int fd;
+  uint8_t in[IN_SIZE];
+  int in_len;
+  Snapshot last;
+  uint32_t last_seq;
+  bool has_last;
+  // The relay first sends the frames since the last keyframe, published
+  // before this viewer joined; their latency is the relay's backlog.
+  uint32_t joined_us;
+  bool caught_up;
+} Viewer;
+
+typedef struct {
+  const char *host;
+  int port; // 0 picks the default of the server or the relay
+  int matches;
+  bool versus;
+  int seconds;
+  int input_hz;
+  bool relay;
+  int viewers;
+  bool publish;
+} Loadgen_Config;
+
+typedef struct {
+  uint64_t states;
+  uint64_t state_bytes;
+  uint64_t undecodable; // baseline no longer in history
+  uint64_t welcomes;
+  uint64_t closed;
+  uint64_t rtt[RTT_BUCKETS];
+  uint64_t rtt_cnt;
+} Loadgen_Stats;
+
+static Loadgen_Stats stats;
+
+static void record_rtt(uint32_t us) {
+  int bucket = us / RTT_BUCKET_US;
+  stats.rtt[bucket < RTT_BUCKETS ? bucket : RTT_BUCKETS - 1]++;
+  stats.rtt_cnt++;
+}
+
+static uint32_t now_us(void) {
+  uint32_t us = profile_now_ns() / 1000;
+  return us ? us : 1; // 0 means no stamp pending
+}
+
+static double rtt_percentile(double p) {
+  uint64_t rank = stats.rtt_cnt * p;
+  uint64_t seen = 0;
+  for (int i = 0; i < RTT_BUCKETS; i++) {
+    seen += stats.rtt[i];
+    if (seen > rank)
+      return (i + 0.5) * RTT_BUCKET_US / 1000.0;
+  }
+  return RTT_BUCKETS * RTT_BUCKET_US / 1000.0;
+}
+
+static void print_rtt_percentile(int percent) {
+  if (stats.rtt_cnt == 0)
+    printf(" p%d n/a", percent);
+  else
+    printf(" p%d %.1fms", percent, rtt_percentile(percent / 100.0));
+}
+
+static void send_frame(Client *c, Server_Msg type, const uint8_t *data,
+                       int len) {
+  uint8_t frame[SERVER_FRAME_HEADER + SERVER_INPUT_SIZE];
+  frame[0] = (len + 1) & 0xff;
+  frame[1] = (len + 1) >> 8;
+  frame[2] = type;
+  memcpy(frame + SERVER_FRAME_HEADER, data, len);
+  // Inputs are tiny; a full socket buffer means the server is the
+  // bottleneck, so the input is simply lost.
+  send(c->fd, frame, SERVER_FRAME_HEADER + len, MSG_NOSIGNAL);
+}
+
+static bool open_client(Client *c, const struct sockaddr_in *addr,
+                        Server_Join_Mode mode) {
+  memset(c, 0, sizeof(*c));
+  c->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (c->fd < 0)
+    return false;
+  if (connect(c->fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+    close(c->fd);
+    c->fd = -1;
+    return false;
+  }
+  int one = 1;
+  setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+  uint8_t join[SERVER_JOIN_SIZE] = {SERVER_PROTO_VERSION, mode};
+  send_frame(c, Server_Msg_Join, join, sizeof(join));
+  return true;
+}
+
+static void close_client(Client *c) {
+  close(c->fd);
+  c->fd = -1;
+  stats.closed++;
+}
+
+static void handle_frame(Client *c, uint8_t type, const uint8_t *p, int len) {
+  if (type == Server_Msg_Welcome) {
+    c->welcomed = true;
+    stats.welcomes++;
+  } else if (type == Server_Msg_State && len >= SERVER_STATE_HEADER) {
+    uint32_t stamp, seq;
+    get_u32(p + 4, &stamp);
+    get_u32(p + 8, &seq);
+    uint8_t back = p[12];
+    stats.states++;
+    stats.state_bytes += SERVER_FRAME_HEADER + len;
+
+    const Snapshot *base = NULL;
+    if (back) {
+      uint32_t slot = (seq - back) % SERVER_SNAPSHOT_HISTORY;
+      if (c->history_seq[slot] != seq - back + 1) {
+        stats.undecodable++;
+        return;
+      }
+      base = &c->history[slot];
+    }
+    Snapshot decoded;
+    if (!snapshot_decode(p + SERVER_STATE_HEADER, len - SERVER_STATE_HEADER,
+                         base, &decoded)) {
+      stats.undecodable++;
+      return;
+    }
+    c->history[seq % SERVER_SNAPSHOT_HISTORY] = decoded;
+    c->history_seq[seq % SERVER_SNAPSHOT_HISTORY] = seq + 1;
+    if (seq + 1 > c->acked)
+      c->acked = seq + 1;
+
+    if (c->pending_stamp && stamp == c->pending_stamp) {
+      record_rtt(now_us() - stamp);
+      c->pending_stamp = 0;
+    }
+  }
+}
+
+static void read_client(Client *c) {
+  for (;;) {
+    ssize_t n = recv(c->fd, c->in + c->in_len, IN_SIZE - c->in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      close_client(c);
+      return;
+    }
+    if (n < 0)
+      return;
+    c->in_len += n;
+
+    int at = 0;
+    while (c->in_len - at >= SERVER_FRAME_HEADER) {
+      int size = c->in[at] | c->in[at + 1] << 8;
+      if (size < 1 || size > IN_SIZE - 2) {
+        close_client(c);
+        return;
+      }
+      if (c->in_len - at < 2 + size)
+        break;
+      handle_frame(c, c->in[at + 2], c->in + at + SERVER_FRAME_HEADER,
+                   size - 1);
+      at += 2 + size;
+    }
+    memmove(c->in, c->in + at, c->in_len - at);
+    c->in_len -= at;
+  }
+}
+
+// New random keys; the stamp lets the State that first carries it time the
+// round trip.
+static void send_input(Client *c, Rng *rng, uint64_t interval_ns) {
+  c->keys = rng_next(rng) >> 62 & (Server_Key_Up | Server_Key_Down);
+  c->pending_stamp = now_us();
+  uint8_t input[SERVER_INPUT_SIZE];
+  input[0] = c->keys;
+  put_u32(input + 1, c->pending_stamp);
+  put_u32(input + 5, c->acked);
+  send_frame(c, Server_Msg_Input, input, sizeof(input));
+  c->next_input_ns += interval_ns;
+}
+
+static bool open_viewer(Viewer *v, const struct sockaddr_in *addr) {
+  memset(v, 0, sizeof(*v));
+  v->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (v->fd < 0)
+    return false;
+  uint8_t hello[BROADCAST_FRAME_HEADER + 1] = {2, 0, Broadcast_Msg_Watch,
+                                               BROADCAST_VERSION};
+  if (connect(v->fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0 ||
+      send(v->fd, hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+    close(v->fd);
+    v->fd = -1;
+    return false;
+  }
+  fcntl(v->fd, F_SETFL, fcntl(v->fd, F_GETFL) | O_NONBLOCK);
+  v->joined_us = broadcast_now_us();
+  return true;
+}
+
+static void handle_snapshot(Viewer *v, const uint8_t *p, int len) {
+  if (len < BROADCAST_SNAPSHOT_HEADER)
+    return;
+  uint32_t seq, stamp;
+  get_u32(p + 4, &seq);
+  get_u32(p + 8, &stamp);
+  stats.states++;
+  stats.state_bytes += BROADCAST_FRAME_HEADER + len;
+  bool keyframe = p[12];
+  if (!keyframe && (!v->has_last || seq != v->last_seq + 1)) {
+    stats.undecodable++;
+    return;
+  }
+  Snapshot decoded;
+  if (!snapshot_decode(p + BROADCAST_SNAPSHOT_HEADER,
+                       len - BROADCAST_SNAPSHOT_HEADER,
+                       keyframe ? NULL : &v->last, &decoded)) {
+    stats.undecodable++;
+    v->has_last = false;
+    return;
+  }
+  v->last = decoded;
+  v->last_seq = seq;
+  v->has_last = true;
+  if (!v->caught_up && (int32_t)(stamp - v->joined_us) > 0)
+    v->caught_up = true;
+  if (v->caught_up)
+    record_rtt(broadcast_now_us() - stamp);
+}
+
+static void close_viewer(Viewer *v) {
+  close(v->fd);
+  v->fd = -1;
+  stats.closed++;
+}
+
+static void read_viewer(Viewer *v) {
+  for (;;) {
+    ssize_t n = recv(v->fd, v->in + v->in_len, IN_SIZE - v->in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      close_viewer(v);
+      return;
+    }
+    if (n < 0)
+      return;
+    v->in_len += n;
+
+    int at = 0;
+    while (v->in_len - at >= BROADCAST_FRAME_HEADER) {
+      int size = v->in[at] | v->in[at + 1] << 8;
+      if (size < 1 || size > IN_SIZE - 2) {
+        close_viewer(v);
+        return;
+      }
+      if (v->in_len - at < 2 + size)
+        break;
+      if (v->in[at + 2] == Broadcast_Msg_Snapshot)
+        handle_snapshot(v, v->in + at + BROADCAST_FRAME_HEADER, size - 1);
+      at += 2 + size;
+    }
+    memmove(v->in, v->in + at, v->in_len - at);
+    v->in_len -= at;
+  }
+}
+
+// The match --publish streams: both paddles AI, scores reset at 11 like
+// pong_server's matches.
+static void step_demo(State *s, Ai_Controller ai[2]) {
+  Input input = ai_decide_state(&ai[Side_Left], s) |
+                ai_decide_state(&ai[Side_Right], s);
+  update_state(s, input, TICK_DELTA);
+  if (s->step == Step_Win_Screen) {
+    if (s->left_player_score >= 11 || s->right_player_score >= 11) {
+      s->left_player_score = 0;
+      s->right_player_score = 0;
+    }
+    init_game_field(s);
+    s->step = Step_Running;
+  }
+}
+
+static int run_relay_load(const Loadgen_Config *config,
+                          const struct sockaddr_in *addr) {
+  Publisher publisher = {.fd = -1};
+  State state;
+  Ai_Controller ai[2];
+  if (config->publish) {
+    char address[300];
+    snprintf(address, sizeof(address), "%s:%d", config->host, config->port);
+    if (!publisher_open(&publisher, address))
+      return 1;
+    init_state(&state, 1);
+    state.step = Step_Running;
+    state.pause = false;
+    Ai_Config ai_config;
+    init_ai_config(&ai_config);
+    for (int side = 0; side < 2; side++)
+      ai_init(&ai[side], side, &ai_config);
+  }
+
+  Viewer *viewers = calloc(config->viewers, sizeof(Viewer));
+  int epoll_fd = epoll_create1(0);
+  if (!viewers || epoll_fd < 0)
+    return 1;
+
+  uint64_t start = profile_now_ns();
+  uint64_t end = start + (uint64_t)config->seconds * 1000000000ull;
+  uint64_t next_report = start + 1000000000ull;
+  uint64_t tick = 0, last_states = 0;
+  int opened = 0, failed = 0;
+  struct epoll_event events[MAX_EVENTS];
+
+  while (profile_now_ns() < end) {
+    for (int i = 0; i < CONNECTS_PER_LOOP && opened + failed < config->viewers;
+         i++) {
+      Viewer *v = &viewers[opened];
+      if (!open_viewer(v, addr)) {
+        failed++;
+        continue;
+      }
+      struct epoll_event ev = {.events = EPOLLIN, .data.ptr = v};
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, v->fd, &ev);
+      opened++;
+    }
+
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 1);
+    for (int i = 0; i < n; i++) {
+      Viewer *v = events[i].data.ptr;
+      if (v->fd >= 0)
+        read_viewer(v);
+    }
+
+    uint64_t now = profile_now_ns();
+    if (config->publish) {
+      uint64_t due = (now - start) * TICK_RATE / 1000000000ull;
+      for (; tick < due; tick++) {
+        step_demo(&state, ai);
+        if (tick % BROADCAST_EVERY == 0)
+          publisher_send(&publisher, &state, tick);
+      }
+    }
+
+    if (now >= next_report) {
+      printf("viewers %d/%d (%d failed, %llu closed), %llu snapshots/s, "
+             "publish-to-view",
+             opened, config->viewers, failed, (unsigned long long)stats.closed,
+             (unsigned long long)(stats.states - last_states));
+      print_rtt_percentile(50);
+      print_rtt_percentile(99);
+      printf("\n");
+      fflush(stdout);
+      last_states = stats.states;
+      next_report += 1000000000ull;
+    }
+  }
+
+  double seconds = (profile_now_ns() - start) / 1e9;
+  printf("%d viewers, %.0f snapshots/s of %.1f bytes (%llu undecodable), "
+         "publish-to-view",
+         opened, stats.states / seconds,
+         stats.states ? (double)stats.state_bytes / stats.states : 0.0,
+         (unsigned long long)stats.undecodable);
+  print_rtt_percentile(50);
+  print_rtt_percentile(90);
+  print_rtt_percentile(99);
+  printf(" (%llu samples)", (unsigned long long)stats.rtt_cnt);
+  if (config->publish)
+    printf(", %llu published frames dropped",
+           (unsigned long long)publisher.dropped);
+  printf("\n");
+
+  for (int i = 0; i < opened; i++)
+    if (viewers[i].fd >= 0)
+      close(viewers[i].fd);
+  publisher_close(&publisher);
+  close(epoll_fd);
+  free(viewers);
+  return 0;
+}
+
+static bool parse_options(Loadgen_Config *c, int argc, char **argv) {
+  c->host = "127.0.0.1";
+  c->port = 0;
+  c->matches = 1000;
+  c->versus = false;
+  c->seconds = 10;
+  c->input_hz = 30;
+  c->relay = false;
+  c->viewers = 1000;
+  c->publish = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--versus") == 0) {
+      c->versus = true;
+      continue;
+    } else if (strcmp(arg, "--relay") == 0) {
+      c->relay = true;
+      continue;
+    } else if (strcmp(arg, "--publish") == 0) {
+      c->publish = true;
+      continue;
+    } else if (!value) {
+      return false;
+    } else if (strcmp(arg, "--host") == 0) {
+      c->host = value;
+    } else if (strcmp(arg, "--port") == 0) {
+      c->port = atoi(value);
+    } else if (strcmp(arg, "--matches") == 0) {
+      c->matches = atoi(value);
+    } else if (strcmp(arg, "--seconds") == 0) {
+      c->seconds = atoi(value);
+    } else if (strcmp(arg, "--input-hz") == 0) {
+      c->input_hz = atoi(value);
+    } else if (strcmp(arg, "--viewers") == 0) {
+      c->viewers = atoi(value);
+    } else {
+      return false;
+    }
+    i++;
+  }
+  if (c->port == 0)
+    c->port = c->relay ? BROADCAST_DEFAULT_PORT : SERVER_DEFAULT_PORT;
+  return c->matches > 0 && c->input_hz > 0 && c->viewers >= 0;
+}
+
+int main(int argc, char **argv) {
+  Loadgen_Config config;
+  if (!parse_options(&config, argc, argv)) {
+    fprintf(stderr,
+            "usage: %s [--host ADDR] [--port N] [--matches N] [--versus]\n"
+            "          [--seconds N] [--input-hz N]\n"
+            "       %s --relay [--host ADDR] [--port N] [--viewers N] "
+            "[--publish]\n"
+            "          [--seconds N]\n",
+            argv[0], argv[0]);
+    return 1;
+  }
+
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(config.port);
+  if (inet_pton(AF_INET, config.host, &addr.sin_addr) != 1) {
+    fprintf(stderr, "loadgen: %s is not an IPv4 address\n", config.host);
+    return 1;
+  }
+  struct rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+  if (config.relay)
+    return run_relay_load(&config, &addr);
+
+  int client_cnt = config.matches * (config.versus ? 2 : 1);
+  Client *clients = calloc(client_cnt, sizeof(Client));
+  int epoll_fd = epoll_create1(0);
+  if (!clients || epoll_fd < 0)
+    return 1;
+  Rng rng;
+  rng_seed(&rng, 1);
+  uint64_t interval_ns = 1000000000ull / config.input_hz;
+
+  uint64_t start = profile_now_ns();
+  uint64_t end = start + (uint64_t)config.seconds * 1000000000ull;
+  uint64_t next_report = start + 1000000000ull;
+  uint64_t last_states = 0;
+  int opened = 0, failed = 0;
+  int next_input = 0;
+  struct epoll_event events[MAX_EVENTS];
+
+  while (profile_now_ns() < end) {
+    // Ramp up a slice at a time so the server keeps ticking meanwhile.
+    for (int i = 0; i < CONNECTS_PER_LOOP && opened + failed < client_cnt;
+         i++) {
+      Client *c = &clients[opened];
+      Server_Join_Mode mode =
+          config.versus ? Server_Join_Versus : Server_Join_Ai;
+      if (!open_client(c, &addr, mode)) {
+        failed++;
+        continue;
+      }
+      // Spread inputs evenly over the interval.
+      c->next_input_ns = start + interval_ns * opened / client_cnt;
+      struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &ev);
+      opened++;
+    }
+
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 1);
+    for (int i = 0; i < n; i++) {
+      Client *c = events[i].data.ptr;
+      if (c->fd >= 0)
+        read_client(c);
+    }
+
+    // Input times are staggered by client index and all advance by the same
+    // interval, so they come due in index order, round and round.
+    uint64_t now = profile_now_ns();
+    for (int sent = 0; sent < opened; sent++) {
+      Client *c = &clients[next_input];
+      if (now < c->next_input_ns)
+        break;
+      if (c->fd >= 0 && c->welcomed)
+        send_input(c, &rng, interval_ns);
+      else
+        c->next_input_ns += interval_ns;
+      next_input = (next_input + 1) % opened;
+    }
+
+    if (now >= next_report) {
+      printf("clients %d/%d (%d failed, %llu closed), %llu welcomed, "
+             "%llu states/s, input-to-state",
+             opened, client_cnt, failed, (unsigned long long)stats.closed,
+             (unsigned long long)stats.welcomes,
+             (unsigned long long)(stats.states - last_states));
+      print_rtt_percentile(50);
+      print_rtt_percentile(99);
+      printf("\n");
+      fflush(stdout);
+      last_states = stats.states;
+      next_report += 1000000000ull;
+    }
+  }
+
+  double seconds = (profile_now_ns() - start) / 1e9;
+  printf("%d matches, %llu of %d clients welcomed, %.0f states/s of "
+         "%.1f bytes (%llu undecodable), input-to-state",
+         config.matches, (unsigned long long)stats.welcomes, client_cnt,
+         stats.states / seconds,
+         stats.states ? (double)stats.state_bytes / stats.states : 0.0,
+         (unsigned long long)stats.undecodable);
+  print_rtt_percentile(50);
+  print_rtt_percentile(90);
+  print_rtt_percentile(99);
+  printf(" (%llu samples)\n", (unsigned long long)stats.rtt_cnt);
+
+  for (int i = 0; i < opened; i++)
+    if (clients[i].fd >= 0)
+      close(clients[i].fd);
+  close(epoll_fd);
+  free(clients);
+  return 0;
+}
@@ -5,244 +5,86 @@
 #include <stdlib.h>
 #include <string.h>
 #include <threads.h>
-
-#define PADDLE_WIDTH 0.03  // 3vw
-#define PADDLE_HEIGHT 0.20 // 20vh
-#define PADDLE_SPEED 1.0   // 1vw per sec
-#define BALL_SIZE 0.03     // 1vw
-#define SCREEN_WIDTH 1.0
-#define SCREEN_HEIGHT 1.0
-#define MAX_Y_VELOCITY 2.0
-#define MAX_X_VELOCITY 2.0
-#define FONT_SIZE 36
-#define UI_PADDING 8
-
-typedef enum {
-  Step_Running,
-  Step_Win_Screen,
-  Step_Main_Menu,
-} Step;
-
-typedef struct {
-  float x;
-  float y;
-  float vx;
-  float vy;
-} Ball;
-
-typedef struct {
-  float x;
-  float y;
-  float h;
-  float w;
-} Paddle;
-
-typedef enum {
-  Main_Menu_Item_Start_Coop,
-  Main_Menu_Item_Exit,
-  Main_Menu_Item_Cnt,
-} Main_Menu_Item;
-
-typedef struct {
-  Main_Menu_Item selected_item;
-} Main_Menu_State;
-
-typedef enum {
-  Win_Screen_Item_Restart,
-  Win_Screen_Item_Main_Menu,
-  Win_Screen_Item_Cnt,
-} Win_Screen_Item;
-
-typedef struct {
-  Win_Screen_Item selected_item;
-  bool left_win;
-} Win_Screen_State;
-
-typedef struct {
-  Ball ball;
-  Paddle left_paddle;
-  Paddle right_paddle;
-  int left_player_score;
-  int right_player_score;
-  Step step;
-  bool pause;
-  Main_Menu_State main_menu;
-  Win_Screen_State win_screen;
-} State;
-
-void init_main_menu(Main_Menu_State *mms) {
-  mms->selected_item = Main_Menu_Item_Start_Coop;
-}
-
-void init_win_screen(Win_Screen_State *wss) {
-  wss->selected_item = Win_Screen_Item_Restart;
-}
-
-void init_game_field(State *s) {
-  s->left_paddle.x = PADDLE_WIDTH * 2.0;
-  s->left_paddle.h = PADDLE_HEIGHT;
-  s->left_paddle.y = SCREEN_HEIGHT / 2.0 - PADDLE_HEIGHT / 2.0;
-  s->left_paddle.w = PADDLE_WIDTH;
-
-  s->right_paddle.x = SCREEN_WIDTH - PADDLE_WIDTH * 3.0;
-  s->right_paddle.h = PADDLE_HEIGHT;
-  s->right_paddle.y = SCREEN_HEIGHT / 2.0 - PADDLE_HEIGHT / 2.0;
-  s->right_paddle.w = PADDLE_WIDTH;
-
-  s->ball.x = SCREEN_WIDTH / 2.0;
-  s->ball.y = SCREEN_HEIGHT / 2.0;
-}
-
-void init_state(State *s) {
-  s->step = Step_Main_Menu;
-  s->pause = true;
-  init_game_field(s);
-  init_main_menu(&s->main_menu);
-  init_win_screen(&s->win_screen);
-}
-
-int get_screen_aspect_ratio() { return GetScreenWidth() / GetScreenHeight(); }
-
-int is_ball_collide_with_paddle(Ball *b, Paddle *p) {
-  int aspect_ratio = get_screen_aspect_ratio();
-
-  if (p->x + p->w < b->x)
-    return false;
-
-  if (p->y + p->h < b->y)
-    return false;
-
-  if (b->x + BALL_SIZE < p->x)
-    return false;
-
-  if (b->y + BALL_SIZE * aspect_ratio < p->y)
-    return false;
-
-  return true;
+#include <time.h>
+
+#include "ai.h"
+#include "archive.h"
+#include "batch.h"
+#include "broadcast.h"
+#include "draw.h"
+#include "input.h"
+#include "latency.h"
+#include "multiball.h"
+#include "netplay.h"
+#include "pacing.h"
+#include "policy.h"
+#include "profile.h"
+#include "replay.h"
+#include "sim.h"
+#include "soa.h"
+#include "trace.h"
+
+#define MAX_FRAME_TIME 0.25 // drop sim time beyond this instead of spiralling
+#define ARCHIVE_SCRUB_TICKS (TICK_RATE * 5)
+#define TICK_NS ((uint64_t)(1e9 / TICK_RATE))
+
+Replay_Writer recorder;
+bool recording = false;
+
+// Solo games put solo_ai, or solo_policy if one was given, on the right
+// paddle.
+Ai_Config ai_config;
+Ai_Controller solo_ai;
+Policy solo_policy;
+bool has_solo_policy = false;
+bool solo = false;
+
+// Per-frame key edges. Paddle keys are sampled per tick by Input_Sampler.
+Input poll_input(void) {
+  Input input = 0;
+  if (IsKeyPressed(KEY_P))
+    input |= Input_Pause;
+  return input;
 }
 
-void update_vy_after_paddle_collision(Ball *b, Paddle *p) {
-  float paddle_center_y = p->y + p->h / 2.0;
-  float ball_center_y = b->y + BALL_SIZE / 2.0;
-  float offset = sqrtf(fabs(paddle_center_y - ball_center_y));
-  if (ball_center_y < paddle_center_y)
-    b->vy -= offset;
-  else
-    b->vy += offset;
-}
-
-void update_ball(State *s) {
-  Ball ball = s->ball;
-  Paddle *left_paddle = &s->left_paddle;
-  Paddle *right_paddle = &s->right_paddle;
-  float delta = GetFrameTime();
-
-  int aspect_ratio = get_screen_aspect_ratio();
-
-  ball.x += ball.vx * aspect_ratio * delta;
-  ball.y += ball.vy * delta;
-
-  bool collided = false;
-
-  if (is_ball_collide_with_paddle(&ball, left_paddle)) {
-    ball.x = left_paddle->x + left_paddle->w;
-    ball.vx = -ball.vx;
-    update_vy_after_paddle_collision(&ball, left_paddle);
-    collided = true;
-  } else if (is_ball_collide_with_paddle(&ball, right_paddle)) {
-    ball.x = right_paddle->x - BALL_SIZE;
-    ball.vx = -ball.vx;
-    update_vy_after_paddle_collision(&ball, right_paddle);
-    collided = true;
-  } else if (ball.y <= 0.0) {
-    ball.y = 0.0;
-    ball.vy = -ball.vy;
-    collided = true;
-  } else if (SCREEN_HEIGHT <= ball.y + BALL_SIZE * aspect_ratio) {
-    ball.y = SCREEN_HEIGHT - BALL_SIZE * aspect_ratio;
-    ball.vy = -ball.vy;
-    collided = true;
-  } else if (ball.x <= 0.0) {
-    ball.x = 0.0;
-    ball.vx = -ball.vx;
-    collided = true;
-  } else if (SCREEN_WIDTH <= ball.x + BALL_SIZE) {
-    ball.x = SCREEN_WIDTH - BALL_SIZE;
-    ball.vx = -ball.vx;
-    collided = true;
-  }
-
-  if (collided) {
-    ball.vy *= GetRandomValue(95, 110) / 100.0;
-    ball.vx *= GetRandomValue(95, 110) / 100.0;
-  } else if (ball.x < left_paddle->x + left_paddle->w) {
-    s->step = Step_Win_Screen;
-    s->win_screen.left_win = false;
-    s->right_player_score += 1;
-    ball.x = right_paddle->x - PADDLE_WIDTH;
-    ball.y = right_paddle->y + right_paddle->h / 2.0;
-    ball.vx = GetRandomValue(20, 40) / 100.0;
-    ball.vy = GetRandomValue(-40, 40) / 100.0;
-  } else if (right_paddle->x < ball.x) {
-    s->step = Step_Win_Screen;
-    s->win_screen.left_win = true;
-    s->left_player_score += 1;
-    ball.x = left_paddle->x + left_paddle->w;
-    ball.y = left_paddle->y + left_paddle->h / 2.0 + BALL_SIZE / 2.0;
-    ball.vx = -GetRandomValue(20, 40) / 100.0;
-    ball.vy = GetRandomValue(-40, 40) / 100.0;
-  }
-
-  s->ball = ball;
-}
-
-void update_paddle(State *s, Paddle *p, int up, int down) {
-  float delta = GetFrameTime();
-
-  if (IsKeyDown(up))
-    p->y -= PADDLE_SPEED * delta;
-  if (IsKeyDown(down))
-    p->y += PADDLE_SPEED * delta;
+Input solo_input(const State *s) {
+  if (!has_solo_policy)
+    return ai_decide_state(&solo_ai, s);
 
-  if (p->y < 0) {
-    p->y = 0;
-  } else if (SCREEN_HEIGHT - p->h < p->y) {
-    p->y = SCREEN_HEIGHT - p->h;
-  }
-}
-
-void update_paddles(State *s) {
-  update_paddle(s, &s->left_paddle, KEY_W, KEY_S);
-  update_paddle(s, &s->right_paddle, KEY_UP, KEY_DOWN);
+  Pong_Observation obs;
+  uint8_t action;
+  policy_observe_state(s, Side_Right, &obs);
+  policy_step(&solo_policy, &obs, &action, 1);
+  return policy_action_input(Side_Right, action);
 }
 
-void handle_input(State *s) {}
-
-void update_state(State *s) {
-  if (s->step == Step_Running) {
-    if (IsKeyPressed(KEY_P)) {
-      s->pause = !s->pause;
-    }
-    if (!s->pause) {
-      update_paddles(s);
-      update_ball(s);
-    }
-  } else if (s->step == Step_Main_Menu) {
+// Menu navigation. Gameplay input goes through poll_input and Input_Sampler
+// into the sim, and so does anything returned from here, so that replays see
+// it.
+Input handle_input(State *s) {
+  if (s->step == Step_Main_Menu) {
     if (IsKeyPressed(KEY_DOWN) || IsKeyPressed(KEY_S)) {
       s->main_menu.selected_item =
           (s->main_menu.selected_item + 1) % Main_Menu_Item_Cnt;
     } else if (IsKeyPressed(KEY_UP) || IsKeyPressed(KEY_W)) {
       s->main_menu.selected_item =
-          (s->main_menu.selected_item - 1) % Main_Menu_Item_Cnt;
+          (s->main_menu.selected_item + Main_Menu_Item_Cnt - 1) %
+          Main_Menu_Item_Cnt;
     } else if (IsKeyPressed(KEY_ENTER)) {
       switch (s->main_menu.selected_item) {
       case Main_Menu_Item_Start_Coop:
+      case Main_Menu_Item_Start_Solo:
+        solo = s->main_menu.selected_item == Main_Menu_Item_Start_Solo;
+        if (solo)
+          ai_init(&solo_ai, Side_Right, &ai_config);
         s->step = Step_Running;
         s->pause = true;
+        if (recording)
+          replay_begin_match(&recorder, s);
         break;
       case Main_Menu_Item_Exit:
         CloseWindow();
-        return;
+        return 0;
         break;
       case Main_Menu_Item_Cnt:
         break;
@@ -254,162 +96,790 @@ void update_state(State *s) {
           (s->win_screen.selected_item + 1) % Win_Screen_Item_Cnt;
     } else if (IsKeyPressed(KEY_UP) || IsKeyPressed(KEY_W)) {
       s->win_screen.selected_item =
-          (s->win_screen.selected_item - 1) % Win_Screen_Item_Cnt;
+          (s->win_screen.selected_item + Win_Screen_Item_Cnt - 1) %
+          Win_Screen_Item_Cnt;
     } else if (IsKeyPressed(KEY_ENTER)) {
       switch (s->win_screen.selected_item) {
       case Win_Screen_Item_Restart:
-        init_game_field(s);
-        s->step = Step_Running;
-        s->pause = true;
-        break;
+        return Input_Restart;
       case Win_Screen_Item_Main_Menu:
         init_main_menu(&s->main_menu);
         s->step = Step_Main_Menu;
+        if (recording)
+          replay_end_match(&recorder);
         break;
       case Win_Screen_Item_Cnt:
         break;
       }
     }
   }
+  return 0;
 }
 
-Rectangle get_real_paddle_dimentions(Paddle *p) {
-  Rectangle r;
-  int scr_w = GetScreenWidth();
-  int scr_h = GetScreenHeight();
-  r.x = p->x * scr_w;
-  r.y = p->y * scr_h;
-  r.width = p->w * scr_w;
-  r.height = p->h * scr_h;
-  return r;
+typedef struct {
+  bool batch;
+  Batch_Config batch_config;
+  uint64_t seed;
+  const char *record_path;
+  const char *replay_path;
+  const char *archive_path;
+  const char *trace_path;
+  const char *latency_path;
+  Pacing_Config pacing;
+  int host_port; // -1 unless hosting a netplay match
+  const char *join_address;
+  Netplay_Config netplay;
+  uint32_t netplay_test_ticks; // 0 unless running the loopback test
+  const char *publish_address;  // pong_relay to stream this game to
+  const char *watch_address;    // pong_relay to spectate from
+  int watch_delay_ms;
+  Multiball_Config multiball; // ball_cnt 0 unless playing multi-ball
+  const char *archive_build_path;
+  const char **archive_replays;
+  int archive_replay_cnt;
+} Options;
+
+void print_usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--batch MATCHES] [--threads N] [--seed SEED]\n"
+          "          [--points N] [--max-ticks N] [--no-soa] [--ai]\n"
+          "          [--ai-plan TICKS] [--ai-reflections N]\n"
+          "          [--policy so:LIB|exec:COMMAND|unix:SOCKET]\n"
+          "          [--record FILE] [--replay FILE] [--archive FILE]\n"
+          "          [--trace OUT.json] [--idle wait|cap|off]\n"
+          "          [--limiter uncapped|vsync|sleep|hybrid] [--fps N]\n"
+          "          [--latency OUT.csv]\n"
+          "          [--host PORT | --join HOST:PORT] [--input-delay TICKS]\n"
+          "          [--net-delay MS] [--net-jitter MS] [--net-loss PCT]\n"
+          "          [--publish HOST:PORT]\n"
+          "       %s --multiball N [--ball-collisions] [--seed SEED]\n"
+          "       %s --netplay-test TICKS [--net-delay MS] ...\n"
+          "       %s --watch HOST:PORT [--watch-delay MS]\n"
+          "       %s --archive-build OUT REPLAY...\n",
+          prog, prog, prog, prog, prog);
 }
 
-Rectangle get_real_ball_rect(Ball *b) {
-  Rectangle r;
-  int scr_w = GetScreenWidth();
-  int scr_h = GetScreenHeight();
-  r.x = b->x * scr_w;
-  r.y = b->y * scr_h;
-  r.width = BALL_SIZE * scr_w;
-  r.height = BALL_SIZE * scr_w;
-  return r;
+bool parse_options(Options *o, int argc, char **argv) {
+  o->batch = false;
+  init_batch_config(&o->batch_config);
+  o->seed = (uint64_t)time(NULL);
+  o->record_path = NULL;
+  o->replay_path = NULL;
+  o->archive_path = NULL;
+  o->trace_path = NULL;
+  o->latency_path = NULL;
+  init_pacing_config(&o->pacing);
+  o->host_port = -1;
+  o->join_address = NULL;
+  init_netplay_config(&o->netplay);
+  o->netplay_test_ticks = 0;
+  o->publish_address = NULL;
+  o->watch_address = NULL;
+  o->watch_delay_ms = 100;
+  init_multiball_config(&o->multiball);
+  o->multiball.ball_cnt = 0;
+  o->archive_build_path = NULL;
+  o->archive_replays = NULL;
+  o->archive_replay_cnt = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      return false;
+    } else if (strcmp(arg, "--no-soa") == 0) {
+      o->batch_config.use_soa = false;
+      continue;
+    } else if (strcmp(arg, "--ai") == 0) {
+      o->batch_config.ai = true;
+      continue;
+    } else if (strcmp(arg, "--ball-collisions") == 0) {
+      o->multiball.ball_collisions = true;
+      continue;
+    } else if (!value) {
+      fprintf(stderr, "missing value for %s\n", arg);
+      return false;
+    } else if (strcmp(arg, "--batch") == 0) {
+      o->batch = true;
+      o->batch_config.match_cnt = atoi(value);
+    } else if (strcmp(arg, "--threads") == 0) {
+      o->batch_config.thread_cnt = atoi(value);
+    } else if (strcmp(arg, "--seed") == 0) {
+      o->seed = strtoull(value, NULL, 10);
+      o->batch_config.seed = o->seed;
+    } else if (strcmp(arg, "--policy") == 0) {
+      o->batch_config.policy_spec = value;
+    } else if (strcmp(arg, "--ai-plan") == 0) {
+      o->batch_config.ai_config.plan_interval = atoi(value);
+    } else if (strcmp(arg, "--ai-reflections") == 0) {
+      o->batch_config.ai_config.max_reflections = atoi(value);
+    } else if (strcmp(arg, "--points") == 0) {
+      o->batch_config.points_to_win = atoi(value);
+    } else if (strcmp(arg, "--max-ticks") == 0) {
+      o->batch_config.max_ticks = strtoull(value, NULL, 10);
+    } else if (strcmp(arg, "--record") == 0) {
+      o->record_path = value;
+    } else if (strcmp(arg, "--replay") == 0) {
+      o->replay_path = value;
+    } else if (strcmp(arg, "--archive") == 0) {
+      o->archive_path = value;
+    } else if (strcmp(arg, "--trace") == 0) {
+      o->trace_path = value;
+    } else if (strcmp(arg, "--latency") == 0) {
+      o->latency_path = value;
+    } else if (strcmp(arg, "--limiter") == 0) {
+      if (!parse_limiter(value, &o->pacing.limiter)) {
+        fprintf(stderr, "unknown limiter %s\n", value);
+        return false;
+      }
+    } else if (strcmp(arg, "--fps") == 0) {
+      o->pacing.target_fps = atoi(value);
+    } else if (strcmp(arg, "--idle") == 0) {
+      if (!parse_idle_mode(value, &o->pacing.idle_mode)) {
+        fprintf(stderr, "unknown idle mode %s\n", value);
+        return false;
+      }
+    } else if (strcmp(arg, "--host") == 0) {
+      o->host_port = atoi(value);
+    } else if (strcmp(arg, "--join") == 0) {
+      o->join_address = value;
+    } else if (strcmp(arg, "--input-delay") == 0) {
+      o->netplay.input_delay = atoi(value);
+    } else if (strcmp(arg, "--net-delay") == 0) {
+      o->netplay.link.delay_ms = atoi(value);
+    } else if (strcmp(arg, "--net-jitter") == 0) {
+      o->netplay.link.jitter_ms = atoi(value);
+    } else if (strcmp(arg, "--net-loss") == 0) {
+      o->netplay.link.loss = atof(value) / 100.0f;
+    } else if (strcmp(arg, "--netplay-test") == 0) {
+      o->netplay_test_ticks = strtoul(value, NULL, 10);
+    } else if (strcmp(arg, "--publish") == 0) {
+      o->publish_address = value;
+    } else if (strcmp(arg, "--watch") == 0) {
+      o->watch_address = value;
+    } else if (strcmp(arg, "--watch-delay") == 0) {
+      o->watch_delay_ms = atoi(value);
+    } else if (strcmp(arg, "--multiball") == 0) {
+      o->multiball.ball_cnt = atoi(value);
+    } else if (strcmp(arg, "--archive-build") == 0) {
+      // Everything after the output path is a replay to pack.
+      o->archive_build_path = value;
+      o->archive_replays = (const char **)argv + i + 2;
+      o->archive_replay_cnt = argc - (i + 2);
+      break;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return false;
+    }
+    i++;
+  }
+  return true;
 }
 
-char game_is_paused_text[] = "Paused";
+int run_batch_mode(Batch_Config *c) {
+  if (c->match_cnt <= 0) {
+    fprintf(stderr, "--batch needs a positive match count\n");
+    return 1;
+  }
 
-void draw_game(State *s) {
-  if (s->pause) {
-    int len = MeasureText(game_is_paused_text, FONT_SIZE);
-    int x = GetScreenWidth() - len - FONT_SIZE;
-    int y = FONT_SIZE;
-    DrawText(game_is_paused_text, x, y, FONT_SIZE, WHITE);
+  Match_Result *results = calloc(c->match_cnt, sizeof(Match_Result));
+  Batch_Report report;
+  if (!results || !run_batch(c, results, &report)) {
+    fprintf(stderr, "failed to start batch\n");
+    free(results);
+    return 1;
+  }
+  if (report.policy_failed)
+    fprintf(stderr, "policy stopped answering, its paddle stood still\n");
+
+  printf("match,seed,left,right,ticks,finished\n");
+  for (int i = 0; i < c->match_cnt; i++) {
+    Match_Result *r = &results[i];
+    printf("%d,%llu,%d,%d,%llu,%d\n", i, (unsigned long long)r->seed,
+           r->left_score, r->right_score, (unsigned long long)r->ticks,
+           r->finished);
   }
 
-  char string_buffer[10];
+  fprintf(stderr,
+          "%d matches, %llu ticks in %.3fs on %d threads (%llu steals, "
+          "%s kernels, %s players%s): %.0f ticks/sec\n",
+          c->match_cnt, (unsigned long long)report.total_ticks,
+          report.seconds, report.thread_cnt,
+          (unsigned long long)report.steals,
+          c->use_soa ? soa_kernel_name() : "no simd",
+          c->ai ? "ai" : "random",
+          c->policy_spec ? ", policy on the right" : "",
+          report.total_ticks / report.seconds);
+
+  free(results);
+  return 0;
+}
 
-  int scr_w = GetScreenWidth();
-  int scr_h = GetScreenHeight();
+int run_archive_build(Options *o) {
+  if (o->archive_replay_cnt == 0) {
+    fprintf(stderr, "--archive-build needs at least one replay\n");
+    return 1;
+  }
+  if (!archive_build(o->archive_build_path, o->archive_replays,
+                     o->archive_replay_cnt)) {
+    fprintf(stderr, "can't write archive %s\n", o->archive_build_path);
+    return 1;
+  }
+  return 0;
+}
 
-  Rectangle left_paddle_rect = get_real_paddle_dimentions(&s->left_paddle);
-  Rectangle right_paddle_rect = get_real_paddle_dimentions(&s->right_paddle);
-  Rectangle ball_rect = get_real_ball_rect(&s->ball);
+// What a player presses to get the next point going in the netplay test:
+// Enter on the win screen, then P since a restart serves paused.
+static Input serve_input(const State *s) {
+  if (s->step == Step_Win_Screen)
+    return Input_Restart;
+  if (s->step == Step_Running && s->pause)
+    return Input_Pause;
+  return 0;
+}
 
-  DrawRectangleRec(left_paddle_rect, RAYWHITE);
-  DrawRectangleRec(right_paddle_rect, RAYWHITE);
-  DrawRectangleRec(ball_rect, RAYWHITE);
+// Loopback netplay test: a host and a guest in this process, both played by
+// Ai_Controller, talk over 127.0.0.1 through the simulated link in real time
+// until both have confirmed `ticks` ticks, then compare their states. The
+// host serves after every point, and the test fails unless it spans at
+// least two, so restarts get rolled back over too.
+int run_netplay_test(const Options *o) {
+  static Netplay host, guest;
+  uint32_t ticks = o->netplay_test_ticks;
+  if (!netplay_host(&host, 0, o->seed, &o->netplay))
+    return 1;
+  char address[32];
+  snprintf(address, sizeof(address), "127.0.0.1:%u",
+           netplay_local_port(&host));
+  Netplay_Config guest_config = o->netplay;
+  guest_config.link_seed++;
+  if (!netplay_join(&guest, address, &guest_config)) {
+    netplay_close(&host);
+    return 1;
+  }
 
-  sprintf(string_buffer, "%d", GetFPS());
-  DrawText(string_buffer, 0, 0, FONT_SIZE, RAYWHITE);
-  sprintf(string_buffer, "%d : %d", s->left_player_score,
-          s->right_player_score);
-  int score_text_length = MeasureText(string_buffer, FONT_SIZE);
-  DrawText(string_buffer, GetScreenWidth() / 2 - score_text_length / 2, 17,
-           FONT_SIZE, RAYWHITE);
+  Netplay *peers[2] = {&host, &guest};
+  Ai_Controller ais[2];
+  ai_init(&ais[0], Side_Left, &o->batch_config.ai_config);
+  ai_init(&ais[1], Side_Right, &o->batch_config.ai_config);
+  // Each peer gets a tick slot every TICK_NS from when it became ready, and
+  // loses the slot if netplay_advance holds the tick back, as in the game.
+  uint64_t start_ns[2] = {0, 0};
+  uint64_t slots[2] = {0, 0};
+  uint32_t next_serve = 0;
+  uint64_t deadline =
+      profile_now_ns() + ticks * TICK_NS + 10 * 1000000000ull;
+  bool done = false;
+
+  while (!done) {
+    uint64_t now = profile_now_ns();
+    if (now > deadline) {
+      fprintf(stderr, "netplay test timed out\n");
+      break;
+    }
+    done = true;
+    for (int i = 0; i < 2; i++) {
+      Netplay *n = peers[i];
+      netplay_poll(n);
+      if (n->ready && start_ns[i] == 0)
+        start_ns[i] = now;
+      if (n->ready) {
+        uint64_t due = (now - start_ns[i]) / TICK_NS;
+        for (; slots[i] < due && n->tick < ticks; slots[i]++) {
+          // Two AIs rally for minutes, so the guest steers away from the
+          // ball and the host scores every couple of seconds. Only the host
+          // serves, and waits input_delay ticks for a key to land before
+          // pressing again, or the pause would toggle more than once.
+          Input input = ai_decide_state(&ais[i], &n->state);
+          if (n == &guest && input) {
+            input ^= Input_Right_Up | Input_Right_Down;
+          } else if (n == &host && n->tick >= next_serve) {
+            Input serve = serve_input(&n->state);
+            if (serve)
+              next_serve = n->tick + n->config.input_delay + 1;
+            input |= serve;
+          }
+          netplay_advance(n, input);
+        }
+      }
+      done &= n->ready && n->tick == ticks && n->remote_confirmed >= ticks;
+    }
+    struct timespec pause = {0, 250000};
+    nanosleep(&pause, NULL);
+  }
+
+  netplay_print_stats(&host, stderr);
+  netplay_print_stats(&guest, stderr);
+  bool match = done && netplay_checksum(&host.state) ==
+                           netplay_checksum(&guest.state);
+  int points = host.state.left_player_score + host.state.right_player_score;
+  fprintf(stderr, "netplay test: states %s after %u ticks, %d points\n",
+          match ? "match" : "differ", ticks, points);
+  if (points < 2)
+    fprintf(stderr, "netplay test: too few points to cover serving\n");
+  netplay_close(&host);
+  netplay_close(&guest);
+  bool ok = match && points >= 2 && host.stats.desyncs == 0 &&
+            guest.stats.desyncs == 0;
+  return ok ? 0 : 1;
 }
 
-void draw_main_menu(State *s) {
-  float screen_w = GetScreenWidth();
-  float screen_h = GetScreenHeight();
-
-  Rectangle menu_container;
-  menu_container.width = FONT_SIZE * 10 + UI_PADDING * 2;
-  menu_container.height = FONT_SIZE * 10 + UI_PADDING * 2;
-  menu_container.x = screen_w / 2 - menu_container.width / 2;
-  menu_container.y = screen_h / 2 - menu_container.height / 2;
-
-  DrawRectangleRec(menu_container, GRAY);
-
-  float x = menu_container.x + UI_PADDING;
-  float y_offset = FONT_SIZE + UI_PADDING;
-
-  float y = menu_container.y + UI_PADDING;
-  DrawText("Start Coop Game", x, y, FONT_SIZE,
-           s->main_menu.selected_item == Main_Menu_Item_Start_Coop ? RAYWHITE
-                                                                   : BLACK);
-  y += y_offset;
-  DrawText("Exit", x, y, FONT_SIZE,
-           s->main_menu.selected_item == Main_Menu_Item_Exit ? RAYWHITE
-                                                             : BLACK);
+// Archive viewer: plays a match from the archive in real time. Left/Right
+// scrub by ARCHIVE_SCRUB_TICKS, Up/Down switch matches, Space pauses.
+int run_archive_viewer(const char *path, const Pacing_Config *pacing) {
+  Archive archive;
+  if (!archive_open(&archive, path)) {
+    fprintf(stderr, "can't read archive %s\n", path);
+    return 1;
+  }
+  if (archive.match_cnt == 0) {
+    fprintf(stderr, "archive %s has no matches\n", path);
+    archive_close(&archive);
+    return 1;
+  }
+
+  Pacer pacer;
+  pacer_init(&pacer, pacing);
+  InitWindow(800, 400, "pong archive");
+  SetWindowState(FLAG_WINDOW_RESIZABLE);
+
+  uint32_t match = 0;
+  uint64_t tick = 0;
+  bool playing = true;
+  State state;
+  archive_seek(&archive, match, tick, &state);
+  State prev_state = state;
+  double accumulator = 0.0;
+  char info[64];
+  Viewport viewport = {0};
+
+  while (!WindowShouldClose()) {
+    viewport_update(&viewport);
+    uint64_t ticks = archive_match_ticks(&archive, match);
+    int64_t seek_to = -1;
+    if (IsKeyPressed(KEY_SPACE))
+      playing = !playing;
+    if (IsKeyPressed(KEY_RIGHT))
+      seek_to = tick + ARCHIVE_SCRUB_TICKS;
+    if (IsKeyPressed(KEY_LEFT))
+      seek_to = tick > ARCHIVE_SCRUB_TICKS ? tick - ARCHIVE_SCRUB_TICKS : 0;
+    if (IsKeyPressed(KEY_DOWN) && match + 1 < archive.match_cnt) {
+      match++;
+      seek_to = 0;
+    }
+    if (IsKeyPressed(KEY_UP) && match > 0) {
+      match--;
+      seek_to = 0;
+    }
+    if (seek_to >= 0) {
+      // Clamped here too, or the clock runs past the end and Left scrubs
+      // back from there.
+      ticks = archive_match_ticks(&archive, match);
+      tick = (uint64_t)seek_to < ticks ? (uint64_t)seek_to : ticks;
+      archive_seek(&archive, match, tick, &state);
+      prev_state = state;
+      accumulator = 0.0;
+    }
+
+    // The frame that ends an idle wait doesn't count as playback time.
+    accumulator += playing && !pacer.idle ? GetFrameTime() : 0.0;
+    if (accumulator > MAX_FRAME_TIME)
+      accumulator = MAX_FRAME_TIME;
+    while (accumulator >= TICK_DELTA) {
+      prev_state = state;
+      if (!archive_step(&archive, match, &tick, &state))
+        playing = false;
+      accumulator -= TICK_DELTA;
+    }
+    pacer_set_idle(&pacer, !playing);
+
+    State render_state =
+        interpolate_state(&prev_state, &state, accumulator / TICK_DELTA);
+
+    BeginDrawing();
+    {
+      ClearBackground(BLACK);
+      draw(&viewport, &render_state);
+      snprintf(info, sizeof(info), "match %u/%u  %.1fs/%.1fs", match + 1,
+               archive.match_cnt, (double)tick / TICK_RATE,
+               (double)ticks / TICK_RATE);
+      DrawText(info, UI_PADDING, viewport.height - FONT_SIZE, FONT_SIZE / 2,
+               GRAY);
+    }
+    pacer_wait(&pacer);
+    EndDrawing();
+    pacer_frame_presented(&pacer);
+  }
+
+  CloseWindow();
+  archive_close(&archive);
+  return 0;
 }
 
-void draw_win_screen(State *s) {
-  float screen_w = GetScreenWidth();
-  float screen_h = GetScreenHeight();
-
-  Rectangle menu_container;
-  menu_container.width = FONT_SIZE * 10 + UI_PADDING * 2;
-  menu_container.height = FONT_SIZE * 10 + UI_PADDING * 2;
-  menu_container.x = screen_w / 2 - menu_container.width / 2;
-  menu_container.y = screen_h - menu_container.height;
-
-  DrawRectangleRec(menu_container, GRAY);
-
-  float x = menu_container.x + UI_PADDING;
-  float y_offset = FONT_SIZE + UI_PADDING;
-
-  float y = menu_container.y + UI_PADDING;
-  DrawText("Restart", x, y, FONT_SIZE,
-           s->win_screen.selected_item == Win_Screen_Item_Restart ? RAYWHITE
-                                                                  : BLACK);
-  y += y_offset;
-  DrawText("Main Menu", x, y, FONT_SIZE,
-           s->win_screen.selected_item == Win_Screen_Item_Main_Menu ? RAYWHITE
-                                                                    : BLACK);
+// Spectator: plays a pong_relay stream delay_ms behind the newest snapshot,
+// interpolating between snapshots so the 60 Hz stream draws smoothly.
+int run_watch_viewer(const char *address, int delay_ms,
+                     const Pacing_Config *pacing) {
+  static Watcher watcher;
+  if (!watcher_open(&watcher, address, delay_ms))
+    return 1;
+
+  Pacer pacer;
+  pacer_init(&pacer, pacing);
+  InitWindow(800, 400, "pong spectator");
+  SetWindowState(FLAG_WINDOW_RESIZABLE);
+
+  char info[96];
+  Viewport viewport = {0};
+  bool live = true;
+
+  while (!WindowShouldClose()) {
+    viewport_update(&viewport);
+    if (live)
+      live = watcher_poll(&watcher);
+
+    const State *prev, *cur;
+    float alpha;
+    bool have = watcher_sample(&watcher, profile_now_ns(), &prev, &cur, &alpha);
+
+    BeginDrawing();
+    {
+      ClearBackground(BLACK);
+      if (have) {
+        State a = *prev, b = *cur;
+        State render_state = interpolate_state(&a, &b, alpha);
+        draw(&viewport, &render_state);
+      }
+      snprintf(info, sizeof(info), "%s %s  delay %dms  %llu snapshots",
+               live ? "watching" : "stream ended", address, delay_ms,
+               (unsigned long long)watcher.received);
+      DrawText(info, UI_PADDING, viewport.height - FONT_SIZE, FONT_SIZE / 2,
+               GRAY);
+    }
+    pacer_wait(&pacer);
+    EndDrawing();
+    pacer_frame_presented(&pacer);
+  }
+
+  CloseWindow();
+  watcher_close(&watcher);
+  return 0;
 }
 
-void draw(State *s) {
-  if (s->step == Step_Main_Menu) {
-    draw_main_menu(s);
-  } else if (s->step == Step_Win_Screen) {
-    draw_win_screen(s);
-  } else {
-    draw_game(s);
+// Multi-ball: coop paddles against config->ball_cnt balls at once, P pauses.
+// The line at the bottom shows what a tick of the simulation costs.
+int run_multiball(const Multiball_Config *config, uint64_t seed,
+                  const Pacing_Config *pacing) {
+  static Multiball m;
+  if (!multiball_init(&m, config, seed)) {
+    fprintf(stderr, "can't allocate %d balls\n", config->ball_cnt);
+    return 1;
+  }
+
+  Pacer pacer;
+  pacer_init(&pacer, pacing);
+  InitWindow(800, 400, "pong multi-ball");
+  SetWindowState(FLAG_WINDOW_RESIZABLE);
+
+  Viewport viewport = {0};
+  Input_Sampler sampler;
+  input_sampler_init(&sampler);
+  double accumulator = 0.0;
+  Input pending_edges = 0;
+  uint64_t sim_ns = 0, sim_ticks = 0;
+  char info[96];
+
+  while (!WindowShouldClose()) {
+    viewport_update(&viewport);
+    Input input = poll_input() | pending_edges;
+    pending_edges = input & INPUT_EDGE_BITS;
+
+    accumulator += pacer.idle ? TICK_DELTA : GetFrameTime();
+    if (accumulator > MAX_FRAME_TIME)
+      accumulator = MAX_FRAME_TIME;
+    uint64_t sim_now_ns = profile_now_ns();
+    while (accumulator >= TICK_DELTA) {
+      input_sampler_poll(&sampler);
+      uint64_t tick_end_ns =
+          sim_now_ns - (uint64_t)((accumulator - TICK_DELTA) * 1e9);
+      Input tick_input =
+          input | input_sampler_tick(&sampler, tick_end_ns - TICK_NS,
+                                     tick_end_ns);
+      m.state.aspect_ratio = viewport.aspect_ratio;
+      uint64_t start = profile_now_ns();
+      multiball_update(&m, tick_input, TICK_DELTA);
+      sim_ns += profile_now_ns() - start;
+      sim_ticks++;
+      input &= ~INPUT_EDGE_BITS;
+      pending_edges = 0;
+      accumulator -= TICK_DELTA;
+    }
+    pacer_set_idle(&pacer, m.state.pause);
+
+    BeginDrawing();
+    {
+      ClearBackground(BLACK);
+      draw_multiball(&viewport, &m, accumulator / TICK_DELTA);
+      snprintf(info, sizeof(info), "%d balls%s  %.3fms/tick",
+               m.balls.count, config->ball_collisions ? ", colliding" : "",
+               sim_ticks ? sim_ns / 1e6 / sim_ticks : 0.0);
+      DrawText(info, UI_PADDING, viewport.height - FONT_SIZE, FONT_SIZE / 2,
+               GRAY);
+    }
+    pacer_wait(&pacer);
+    EndDrawing();
+    pacer_frame_presented(&pacer);
   }
+
+  CloseWindow();
+  multiball_free(&m);
+  return 0;
 }
 
-int main() {
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(&options, argc, argv)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (options.batch)
+    return run_batch_mode(&options.batch_config);
+  if (options.archive_build_path)
+    return run_archive_build(&options);
+  if (options.archive_path)
+    return run_archive_viewer(options.archive_path, &options.pacing);
+  if (options.netplay_test_ticks)
+    return run_netplay_test(&options);
+  if (options.multiball.ball_cnt > 0)
+    return run_multiball(&options.multiball, options.seed, &options.pacing);
+  if (options.watch_address)
+    return run_watch_viewer(options.watch_address, options.watch_delay_ms,
+                            &options.pacing);
+  ai_config = options.batch_config.ai_config;
+  if (options.batch_config.policy_spec) {
+    if (!policy_open(&solo_policy, options.batch_config.policy_spec)) {
+      fprintf(stderr, "can't open policy %s\n",
+              options.batch_config.policy_spec);
+      return 1;
+    }
+    has_solo_policy = true;
+  }
+
+  Replay_Reader player;
+  bool replaying = options.replay_path != NULL;
+  if (replaying && !replay_reader_open(&player, options.replay_path)) {
+    fprintf(stderr, "can't read replay %s\n", options.replay_path);
+    return 1;
+  }
+  if (options.record_path) {
+    if (!replay_writer_open(&recorder, options.record_path, options.seed)) {
+      fprintf(stderr, "can't write replay %s\n", options.record_path);
+      return 1;
+    }
+    recording = true;
+  }
+
+  // Netplay starts straight into a running match, no menus, no recording.
+  static Netplay net;
+  bool netplaying = options.host_port >= 0 || options.join_address;
+  if (options.host_port >= 0 &&
+      !netplay_host(&net, options.host_port, options.seed, &options.netplay))
+    return 1;
+  if (options.join_address &&
+      !netplay_join(&net, options.join_address, &options.netplay))
+    return 1;
+
+  // Spectators see every tick that is simulated here, replays included.
+  static Publisher publisher;
+  bool publishing = options.publish_address != NULL;
+  if (publishing && !publisher_open(&publisher, options.publish_address))
+    return 1;
+  uint32_t published_tick = 0;
+
+  Pacer pacer;
+  pacer_init(&pacer, &options.pacing);
   InitWindow(800, 400, "pong");
   SetWindowState(FLAG_WINDOW_RESIZABLE);
-  SetTargetFPS(0);
 
   State state;
-  init_state(&state);
-
-  state.ball.vx = 0.3;
-  state.ball.vy = 0.3;
+  init_state(&state, options.seed);
+  if (netplaying)
+    state.step = Step_Running; // paused until the peer shows up
+  State prev_state = state;
+
+  double accumulator = 0.0;
+  Input pending_edges = 0;
+  bool replay_done = false;
+  bool show_profile = false;
+
+  profile_enable();
+
+  Trace_Writer tracer;
+  bool tracing = options.trace_path != NULL;
+  if (tracing && !trace_start(&tracer, options.trace_path)) {
+    fprintf(stderr, "can't write trace %s\n", options.trace_path);
+    tracing = false;
+  }
 
-  while (true) {
-    update_state(&state);
+  Viewport viewport = {0};
+  Input_Sampler sampler;
+  input_sampler_init(&sampler);
+  Latency_Probe probe;
+  latency_probe_init(&probe);
+
+  while (!replay_done) {
+    profile_frame_begin();
+    viewport_update(&viewport);
+
+    uint64_t t = profile_begin();
+    Input menu_input = 0;
+    if (netplaying) {
+      // Either player can serve the next point.
+      if (state.step == Step_Win_Screen && IsKeyPressed(KEY_ENTER))
+        menu_input = Input_Restart;
+    } else if (!replaying) {
+      menu_input = handle_input(&state);
+    }
 
     if (WindowShouldClose())
       break;
 
+    if (IsKeyPressed(KEY_F3))
+      show_profile = !show_profile;
+
+    // Edges are kept until a tick actually consumes them.
+    Input input = poll_input() | menu_input | pending_edges;
+    pending_edges = input & INPUT_EDGE_BITS;
+    profile_end(Profile_Zone_Input, t);
+
+    // Time spent idle is not game time: run one tick to consume the input
+    // that woke us up, not a burst of catch-up ticks.
+    double frame_time = GetFrameTime();
+    if (pacer.idle && frame_time > TICK_DELTA)
+      frame_time = TICK_DELTA;
+    accumulator += frame_time;
+    if (accumulator > MAX_FRAME_TIME)
+      accumulator = MAX_FRAME_TIME;
+    // Sim time catches up to now; the accumulator is what is left over.
+    uint64_t sim_now_ns = profile_now_ns();
+    if (netplaying) {
+      netplay_poll(&net);
+      if (net.ready)
+        state = net.state; // may have rolled back
+    }
+
+    while (accumulator >= TICK_DELTA) {
+      Input tick_input = input;
+      if (replaying) {
+        if (!replay_next_tick(&player, &state, &tick_input)) {
+          replay_done = true;
+          break;
+        }
+      } else {
+        input_sampler_poll(&sampler);
+        viewport_update(&viewport); // the poll may have delivered a resize
+        uint64_t tick_end_ns =
+            sim_now_ns - (uint64_t)((accumulator - TICK_DELTA) * 1e9);
+        tick_input |=
+            input_sampler_tick(&sampler, tick_end_ns - TICK_NS, tick_end_ns);
+        // Both netplay peers have to simulate the same field, so the match
+        // keeps its own aspect and is drawn letterboxed instead.
+        if (!netplaying)
+          state.aspect_ratio = viewport.aspect_ratio;
+        if (solo)
+          tick_input = (tick_input & ~ai_side_mask(Side_Right)) |
+                       solo_input(&state);
+        if (recording && !netplaying)
+          replay_record_tick(&recorder, &state, tick_input);
+      }
+
+      prev_state = state;
+      t = profile_begin();
+      if (netplaying) {
+        // A tick held back to wait for the peer is dropped, not made up.
+        netplay_advance(&net, netplay_side_input(net.side, tick_input));
+        if (net.ready)
+          state = net.state;
+      } else {
+        update_state(&state, tick_input, TICK_DELTA);
+      }
+      profile_end(Profile_Zone_Update_State, t);
+      if (publishing && ++published_tick % BROADCAST_EVERY == 0)
+        publisher_send(&publisher, &state, published_tick);
+      // Only presses that moved a paddle count.
+      if (!replaying && sampler.press_ns && !is_state_static(&state))
+        latency_probe_input(&probe, sampler.press_ns);
+      input &= ~INPUT_EDGE_BITS;
+      pending_edges = 0;
+      accumulator -= TICK_DELTA;
+    }
+
+    // Replays have to keep running through menus and pauses, and netplay
+    // has to keep polling its peer while the match waits for it.
+    pacer_set_idle(&pacer,
+                   !replaying && !netplaying && is_state_static(&state));
+
+    State render_state =
+        interpolate_state(&prev_state, &state, accumulator / TICK_DELTA);
+
+    t = profile_begin();
     BeginDrawing();
     {
       ClearBackground(BLACK);
-      draw(&state);
+      if (netplaying)
+        draw_letterboxed(&viewport, &render_state);
+      else
+        draw(&viewport, &render_state);
+      if (show_profile)
+        draw_profile_overlay(&pacer);
     }
+    profile_end(Profile_Zone_Draw, t);
+
+    pacer_wait(&pacer);
+    t = profile_begin();
     EndDrawing();
+    profile_end(Profile_Zone_End_Drawing, t);
+    pacer_frame_presented(&pacer);
+    latency_probe_presented(&probe, profile_now_ns());
+
+    profile_frame_end();
+  }
+
+  if (replaying) {
+    fprintf(stderr, "replay finished after %llu ticks, %llu desyncs\n",
+            (unsigned long long)player.tick,
+            (unsigned long long)player.desyncs);
+    replay_reader_close(&player);
+  }
+  if (recording)
+    replay_writer_close(&recorder);
+  if (has_solo_policy)
+    policy_close(&solo_policy);
+  if (netplaying) {
+    netplay_print_stats(&net, stderr);
+    netplay_close(&net);
+  }
+  if (publishing) {
+    fprintf(stderr, "publish: %u snapshots sent, %llu dropped\n",
+            publisher.seq, (unsigned long long)publisher.dropped);
+    publisher_close(&publisher);
+  }
+  if (tracing) {
+    trace_stop(&tracer);
+    fprintf(stderr, "trace: %llu frames written, %llu dropped\n",
+            (unsigned long long)tracer.written,
+            (unsigned long long)tracer.dropped);
+  }
+  fprintf(stderr, "pacing: %s, %llu frames, mean %.3fms, jitter %.3fms\n",
+          limiter_names[pacer.config.limiter],
+          (unsigned long long)pacer.interval_cnt, pacer_mean_frame_ms(&pacer),
+          pacer_jitter_ms(&pacer));
+  if (options.latency_path) {
+    latency_probe_print(&probe, &pacer.config, stderr);
+    if (!latency_probe_append_csv(&probe, &pacer.config,
+                                  options.latency_path))
+      fprintf(stderr, "can't write latency %s\n", options.latency_path);
   }
 
   return 0;
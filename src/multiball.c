@@ -0,0 +1,326 @@
+#include "multiball.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+#define GRID_MAX_CELLS (MULTIBALL_GRID_COLS * MULTIBALL_GRID_MAX_ROWS)
+
+void init_multiball_config(Multiball_Config *c) {
+  c->ball_cnt = 1000;
+  c->ball_collisions = false;
+}
+
+static float *alloc_floats(int n) {
+  size_t size = ((size_t)n * sizeof(float) + 63) & ~(size_t)63;
+  return aligned_alloc(64, size ? size : 64);
+}
+
+bool ball_pool_init(Ball_Pool *p, int capacity) {
+  memset(p, 0, sizeof(*p));
+  p->x = alloc_floats(capacity);
+  p->y = alloc_floats(capacity);
+  p->vx = alloc_floats(capacity);
+  p->vy = alloc_floats(capacity);
+  p->capacity = capacity;
+  if (!p->x || !p->y || !p->vx || !p->vy) {
+    ball_pool_free(p);
+    return false;
+  }
+  return true;
+}
+
+void ball_pool_free(Ball_Pool *p) {
+  free(p->x);
+  free(p->y);
+  free(p->vx);
+  free(p->vy);
+  memset(p, 0, sizeof(*p));
+}
+
+int ball_pool_add(Ball_Pool *p, const Ball *b) {
+  if (p->count == p->capacity)
+    return -1;
+  ball_pool_set(p, p->count, b);
+  return p->count++;
+}
+
+Ball ball_pool_get(const Ball_Pool *p, int i) {
+  return (Ball){p->x[i], p->y[i], p->vx[i], p->vy[i]};
+}
+
+void ball_pool_set(Ball_Pool *p, int i, const Ball *b) {
+  p->x[i] = b->x;
+  p->y[i] = b->y;
+  p->vx[i] = b->vx;
+  p->vy[i] = b->vy;
+}
+
+bool ball_grid_init(Ball_Grid *g, int capacity) {
+  memset(g, 0, sizeof(*g));
+  g->cell_start = calloc(GRID_MAX_CELLS + 1, sizeof(uint32_t));
+  g->cell_fill = calloc(GRID_MAX_CELLS, sizeof(uint32_t));
+  g->cell_of = calloc(capacity ? capacity : 1, sizeof(uint32_t));
+  g->order = calloc(capacity ? capacity : 1, sizeof(uint32_t));
+  if (!g->cell_start || !g->cell_fill || !g->cell_of || !g->order) {
+    ball_grid_free(g);
+    return false;
+  }
+  return true;
+}
+
+void ball_grid_free(Ball_Grid *g) {
+  free(g->cell_start);
+  free(g->cell_fill);
+  free(g->cell_of);
+  free(g->order);
+  memset(g, 0, sizeof(*g));
+}
+
+static int grid_col(const Ball_Grid *g, float x) {
+  int col = (int)(x / g->cell_w);
+  return col < 0 ? 0 : col >= g->cols ? g->cols - 1 : col;
+}
+
+static int grid_row(const Ball_Grid *g, float y) {
+  int row = (int)(y / g->cell_h);
+  return row < 0 ? 0 : row >= g->rows ? g->rows - 1 : row;
+}
+
+void ball_grid_build(Ball_Grid *g, const Ball_Pool *p, float aspect_ratio) {
+  // Cells at least a ball wide and tall, so touching balls are at most one
+  // cell apart. Fewer rows than fit only makes the cells taller.
+  int rows = (int)(SCREEN_HEIGHT / (BALL_SIZE * aspect_ratio));
+  g->cols = MULTIBALL_GRID_COLS;
+  g->rows = rows < 1 ? 1 : rows > MULTIBALL_GRID_MAX_ROWS
+                               ? MULTIBALL_GRID_MAX_ROWS
+                               : rows;
+  g->cell_w = SCREEN_WIDTH / g->cols;
+  g->cell_h = SCREEN_HEIGHT / g->rows;
+  int cell_cnt = g->cols * g->rows;
+
+  memset(g->cell_start, 0, (cell_cnt + 1) * sizeof(uint32_t));
+  for (int i = 0; i < p->count; i++) {
+    uint32_t c = grid_row(g, p->y[i]) * g->cols + grid_col(g, p->x[i]);
+    g->cell_of[i] = c;
+    g->cell_start[c + 1]++;
+  }
+  for (int c = 0; c < cell_cnt; c++)
+    g->cell_start[c + 1] += g->cell_start[c];
+  memcpy(g->cell_fill, g->cell_start, cell_cnt * sizeof(uint32_t));
+  for (int i = 0; i < p->count; i++)
+    g->order[g->cell_fill[g->cell_of[i]]++] = i;
+}
+
+// Served from the middle towards `direction` (-1 left, 1 right) with the
+// speeds score_point uses.
+static Ball serve_ball(Rng *rng, float x, int direction) {
+  Ball b;
+  b.x = x;
+  b.y = rng_range(rng, 20, 80) / 100.0;
+  b.vx = direction * rng_range(rng, 20, 40) / 100.0;
+  b.vy = rng_range(rng, -40, 40) / 100.0;
+  return b;
+}
+
+bool multiball_init(Multiball *m, const Multiball_Config *c, uint64_t seed) {
+  memset(m, 0, sizeof(*m));
+  m->config = *c;
+  if (m->config.ball_cnt < 1)
+    m->config.ball_cnt = 1;
+  if (m->config.ball_cnt > MULTIBALL_MAX_BALLS)
+    m->config.ball_cnt = MULTIBALL_MAX_BALLS;
+  if (!ball_pool_init(&m->balls, m->config.ball_cnt) ||
+      !ball_grid_init(&m->grid, m->config.ball_cnt)) {
+    multiball_free(m);
+    return false;
+  }
+
+  init_state(&m->state, seed);
+  m->state.step = Step_Running;
+  m->state.pause = false;
+  // Spread over the middle third so they don't all start on top of each
+  // other.
+  Rng *rng = &m->state.rng;
+  for (int i = 0; i < m->config.ball_cnt; i++) {
+    float x = rng_range(rng, 33, 66) / 100.0;
+    Ball b = serve_ball(rng, x, rng_range(rng, 0, 1) ? 1 : -1);
+    ball_pool_add(&m->balls, &b);
+  }
+  return true;
+}
+
+void multiball_free(Multiball *m) {
+  ball_pool_free(&m->balls);
+  ball_grid_free(&m->grid);
+}
+
+// Straight-line motion and wall bounces for every ball, written without
+// branches so the compiler can vectorize it.
+static void move_balls(Ball_Pool *p, float aspect_ratio, float delta) {
+  float step_x = aspect_ratio * delta;
+  float bottom_wall = SCREEN_HEIGHT - BALL_SIZE * aspect_ratio;
+  float *restrict x = p->x;
+  float *restrict y = p->y;
+  const float *restrict vx = p->vx;
+  float *restrict vy = p->vy;
+  for (int i = 0; i < p->count; i++) {
+    x[i] += vx[i] * step_x;
+    float ny = y[i] + vy[i] * delta;
+    float nvy = vy[i];
+    bool top = ny < 0.0f;
+    ny = top ? -ny : ny;
+    nvy = top ? -nvy : nvy;
+    bool bottom = ny > bottom_wall;
+    ny = bottom ? 2.0f * bottom_wall - ny : ny;
+    nvy = bottom ? -nvy : nvy;
+    y[i] = ny;
+    vy[i] = nvy;
+  }
+}
+
+// A ball entirely past either edge is a point for the other side and comes
+// back from the middle, towards the side that scored.
+static void score_balls(Multiball *m) {
+  Ball_Pool *p = &m->balls;
+  State *s = &m->state;
+  for (int i = 0; i < p->count; i++) {
+    if (p->x[i] > -BALL_SIZE && p->x[i] < SCREEN_WIDTH)
+      continue;
+    bool left_win = p->x[i] >= SCREEN_WIDTH;
+    if (left_win)
+      s->left_player_score++;
+    else
+      s->right_player_score++;
+    Ball b = serve_ball(&s->rng, SCREEN_WIDTH / 2.0 - BALL_SIZE / 2.0,
+                        left_win ? -1 : 1);
+    ball_pool_set(p, i, &b);
+  }
+}
+
+// Balls whose leading edge crossed the paddle face during this step while
+// overlapping it vertically bounce, as in update_ball. Only the cells between
+// the furthest a ball can be after crossing and the face are visited.
+static void hit_paddle(Multiball *m, Paddle *paddle, bool left, float delta) {
+  Ball_Pool *p = &m->balls;
+  Ball_Grid *g = &m->grid;
+  float aspect_ratio = m->state.aspect_ratio;
+  float step_x = aspect_ratio * delta;
+  float reach = MAX_X_VELOCITY * step_x;
+  float ball_h = BALL_SIZE * aspect_ratio;
+  float face = left ? paddle->x + paddle->w : paddle->x - BALL_SIZE;
+  float min_x = left ? face - reach : face;
+  float max_x = left ? face : face + reach;
+
+  int col_end = grid_col(g, max_x);
+  int row_end = grid_row(g, paddle->y + paddle->h);
+  for (int row = grid_row(g, paddle->y - ball_h); row <= row_end; row++) {
+    for (int col = grid_col(g, min_x); col <= col_end; col++) {
+      int cell = row * g->cols + col;
+      for (uint32_t k = g->cell_start[cell]; k < g->cell_start[cell + 1];
+           k++) {
+        uint32_t i = g->order[k];
+        m->stats.paddle_tests++;
+        float x = p->x[i];
+        float prev_x = x - p->vx[i] * step_x;
+        bool crossed = left ? x < face && prev_x >= face
+                            : x > face && prev_x <= face;
+        if (!crossed || p->y[i] + ball_h < paddle->y ||
+            paddle->y + paddle->h < p->y[i])
+          continue;
+        Ball b = ball_pool_get(p, i);
+        b.x = face;
+        b.vx = -b.vx;
+        update_vy_after_paddle_collision(&b, paddle);
+        jitter_ball_after_collision(&b, &m->state.rng);
+        ball_pool_set(p, i, &b);
+        m->stats.bounces++;
+      }
+    }
+  }
+}
+
+// Overlapping balls moving towards each other swap their velocities along
+// the axis they overlap least on, like equal masses would, and are pushed
+// apart. Distances compare in pixels: a ball is as tall as it is wide.
+static void collide_pair(Multiball *m, uint32_t i, uint32_t j) {
+  Ball_Pool *p = &m->balls;
+  float aspect_ratio = m->state.aspect_ratio;
+  float dx = p->x[j] - p->x[i];
+  float dy = (p->y[j] - p->y[i]) / aspect_ratio;
+  float depth_x = BALL_SIZE - fabsf(dx);
+  float depth_y = BALL_SIZE - fabsf(dy);
+  m->stats.pair_tests++;
+  if (depth_x <= 0 || depth_y <= 0)
+    return;
+  if (depth_x < depth_y) {
+    float push = (dx < 0 ? -depth_x : depth_x) / 2;
+    p->x[i] -= push;
+    p->x[j] += push;
+    if ((p->vx[j] - p->vx[i]) * dx >= 0)
+      return;
+    float v = p->vx[i];
+    p->vx[i] = p->vx[j];
+    p->vx[j] = v;
+  } else {
+    float push = (dy < 0 ? -depth_y : depth_y) * aspect_ratio / 2;
+    p->y[i] -= push;
+    p->y[j] += push;
+    if ((p->vy[j] - p->vy[i]) * dy >= 0)
+      return;
+    float v = p->vy[i];
+    p->vy[i] = p->vy[j];
+    p->vy[j] = v;
+  }
+  m->stats.bounces++;
+}
+
+// Every pair once: within a cell, and against the right neighbour and the
+// three cells below.
+static void collide_balls(Multiball *m) {
+  static const int neighbours[][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+  const Ball_Grid *g = &m->grid;
+  for (int row = 0; row < g->rows; row++) {
+    for (int col = 0; col < g->cols; col++) {
+      int cell = row * g->cols + col;
+      uint32_t begin = g->cell_start[cell], end = g->cell_start[cell + 1];
+      for (uint32_t a = begin; a < end; a++)
+        for (uint32_t b = a + 1; b < end; b++)
+          collide_pair(m, g->order[a], g->order[b]);
+
+      for (int n = 0; n < 4; n++) {
+        int ncol = col + neighbours[n][0], nrow = row + neighbours[n][1];
+        if (ncol < 0 || ncol >= g->cols || nrow >= g->rows)
+          continue;
+        int other = nrow * g->cols + ncol;
+        for (uint32_t a = begin; a < end; a++)
+          for (uint32_t b = g->cell_start[other];
+               b < g->cell_start[other + 1]; b++)
+            collide_pair(m, g->order[a], g->order[b]);
+      }
+    }
+  }
+}
+
+void multiball_update(Multiball *m, Input input, float delta) {
+  State *s = &m->state;
+  if (input & Input_Pause)
+    s->pause = !s->pause;
+  if (s->pause)
+    return;
+
+  update_paddles(s, input, delta);
+  uint64_t t = profile_begin();
+  move_balls(&m->balls, s->aspect_ratio, delta);
+  score_balls(m);
+  ball_grid_build(&m->grid, &m->balls, s->aspect_ratio);
+  // Paddles first: hit_paddle works out where a ball was from its velocity,
+  // which a ball-ball collision would already have changed.
+  hit_paddle(m, &s->left_paddle, true, delta);
+  hit_paddle(m, &s->right_paddle, false, delta);
+  if (m->config.ball_collisions)
+    collide_balls(m);
+  profile_end(Profile_Zone_Update_Ball, t);
+}
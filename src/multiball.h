@@ -0,0 +1,92 @@
+#ifndef PONG_MULTIBALL_H
+#define PONG_MULTIBALL_H
+
+// Multi-ball mode: the usual paddles and score, but up to MULTIBALL_MAX_BALLS
+// balls at once. It doubles as the stress test for the simulation core.
+//
+// Balls live in a Ball_Pool, one 64-byte aligned array per field, so the
+// integration loop streams through them. Every tick a Ball_Grid buckets them
+// into cells at least a ball in size with a counting sort. Each paddle then
+// only tests the balls in the cells its face sweeps, and ball-ball
+// collisions, when enabled, only test a ball against its own and neighbouring
+// cells.
+//
+// The rules follow update_ball, except that a ball scores when it leaves the
+// field and is served again from the middle. Walls don't jitter a ball, so
+// the integration loop stays branch-free.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+#define MULTIBALL_MAX_BALLS 100000
+#define MULTIBALL_GRID_COLS ((int)(SCREEN_WIDTH / BALL_SIZE))
+#define MULTIBALL_GRID_MAX_ROWS 64
+
+typedef struct {
+  int ball_cnt;
+  bool ball_collisions;
+} Multiball_Config;
+
+// Structure of arrays, allocated once for `capacity` balls.
+typedef struct {
+  float *x;
+  float *y;
+  float *vx;
+  float *vy;
+  int count;
+  int capacity;
+} Ball_Pool;
+
+// Balls bucketed by cell: cell c holds order[cell_start[c]] up to
+// order[cell_start[c + 1]]. Cells are row-major, rows cover the height.
+typedef struct {
+  int cols;
+  int rows;
+  float cell_w;
+  float cell_h;
+  uint32_t *cell_start; // MULTIBALL_GRID_COLS * MULTIBALL_GRID_MAX_ROWS + 1
+  uint32_t *cell_fill;  // scratch for the counting sort
+  uint32_t *cell_of;    // per ball
+  uint32_t *order;      // ball indices sorted by cell
+} Ball_Grid;
+
+typedef struct {
+  uint64_t paddle_tests; // balls the broadphase handed to a paddle
+  uint64_t pair_tests;   // ball pairs in neighbouring cells
+  uint64_t bounces;      // off paddles and other balls
+} Multiball_Stats;
+
+typedef struct {
+  // Paddles, score, pause, RNG and aspect ratio; its own ball is unused.
+  State state;
+  Ball_Pool balls;
+  Ball_Grid grid;
+  Multiball_Config config;
+  Multiball_Stats stats;
+} Multiball;
+
+void init_multiball_config(Multiball_Config *c);
+
+bool ball_pool_init(Ball_Pool *p, int capacity);
+void ball_pool_free(Ball_Pool *p);
+// Returns the new ball's index, or -1 when the pool is full.
+int ball_pool_add(Ball_Pool *p, const Ball *b);
+Ball ball_pool_get(const Ball_Pool *p, int i);
+void ball_pool_set(Ball_Pool *p, int i, const Ball *b);
+
+bool ball_grid_init(Ball_Grid *g, int capacity);
+void ball_grid_free(Ball_Grid *g);
+// Sizes the cells for `aspect_ratio` and buckets every ball of the pool.
+void ball_grid_build(Ball_Grid *g, const Ball_Pool *p, float aspect_ratio);
+
+// Starts a running, unpaused match with config->ball_cnt balls served from
+// the middle. Returns false if the pool or grid can't be allocated.
+bool multiball_init(Multiball *m, const Multiball_Config *c, uint64_t seed);
+void multiball_free(Multiball *m);
+// update_state for multi-ball: Input_Pause toggles the pause, paddles move,
+// and every ball moves, bounces and scores.
+void multiball_update(Multiball *m, Input input, float delta);
+
+#endif
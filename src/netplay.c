@@ -0,0 +1,459 @@
+#include "netplay.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "profile.h"
+
+#define NETPLAY_VERSION 1
+#define HELLO_INTERVAL_NS 100000000ull // 100ms between join attempts
+#define MAX_PACKET_INPUTS 64
+#define INPUT_HEADER_SIZE 25
+#define SYNC_THRESHOLD 4 // ticks of advantage difference before slowing down
+
+typedef enum {
+  Packet_Hello = 1,
+  Packet_Input = 2,
+} Packet_Type;
+
+void init_netplay_config(Netplay_Config *c) {
+  c->input_delay = 2;
+  c->link.delay_ms = 0;
+  c->link.jitter_ms = 0;
+  c->link.loss = 0;
+  c->link_seed = 1;
+}
+
+static bool open_socket(Netplay *n, uint16_t port, const Netplay_Config *c) {
+  memset(n, 0, sizeof(*n));
+  n->config = *c;
+  if (n->config.input_delay < 0)
+    n->config.input_delay = 0;
+  if (n->config.input_delay > NETPLAY_MAX_INPUT_DELAY)
+    n->config.input_delay = NETPLAY_MAX_INPUT_DELAY;
+  rng_seed(&n->link_rng, c->link_seed);
+
+  n->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (n->sock < 0) {
+    perror("netplay: socket");
+    return false;
+  }
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(n->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    perror("netplay: bind");
+    close(n->sock);
+    return false;
+  }
+  return true;
+}
+
+bool netplay_host(Netplay *n, uint16_t port, uint64_t seed,
+                  const Netplay_Config *c) {
+  if (!open_socket(n, port, c))
+    return false;
+  n->host = true;
+  n->side = Side_Left;
+  n->seed = seed;
+  return true;
+}
+
+bool netplay_join(Netplay *n, const char *address, const Netplay_Config *c) {
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  if (!colon || colon == address ||
+      (size_t)(colon - address) >= sizeof(host)) {
+    fprintf(stderr, "netplay: %s is not HOST:PORT\n", address);
+    return false;
+  }
+  memcpy(host, address, colon - address);
+  host[colon - address] = '\0';
+
+  struct addrinfo hints = {0};
+  struct addrinfo *info;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  int err = getaddrinfo(host, colon + 1, &hints, &info);
+  if (err != 0) {
+    fprintf(stderr, "netplay: %s: %s\n", address, gai_strerror(err));
+    return false;
+  }
+  if (!open_socket(n, 0, c)) {
+    freeaddrinfo(info);
+    return false;
+  }
+  memcpy(&n->peer, info->ai_addr, sizeof(n->peer));
+  freeaddrinfo(info);
+  n->has_peer = true;
+  n->side = Side_Right;
+  return true;
+}
+
+void netplay_close(Netplay *n) {
+  if (n->sock >= 0)
+    close(n->sock);
+  n->sock = -1;
+}
+
+uint16_t netplay_local_port(const Netplay *n) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(n->sock, (struct sockaddr *)&addr, &len) != 0)
+    return 0;
+  return ntohs(addr.sin_port);
+}
+
+uint32_t netplay_checksum(const State *s) {
+  uint8_t blob[STATE_BLOB_SIZE];
+  pack_state(s, blob);
+  uint32_t h = 2166136261u; // FNV-1a
+  for (int i = 0; i < STATE_BLOB_SIZE; i++)
+    h = (h ^ blob[i]) * 16777619u;
+  return h;
+}
+
+Input netplay_side_input(Side side, Input keys) {
+  Input own = keys & ai_side_mask(side);
+  Input other = keys & ai_side_mask(side == Side_Left ? Side_Right : Side_Left);
+  if (own & (Input_Left_Up | Input_Left_Down | Input_Right_Up |
+             Input_Right_Down))
+    return own | (keys & INPUT_EDGE_BITS);
+  // Two key bits and their two 4-bit hold fields per side.
+  Input moved = side == Side_Left
+                    ? (other >> 2 & 0x3) | (other >> 16 & 0xff) << 8
+                    : (other & 0x3) << 2 | (other >> 8 & 0xff) << 16;
+  return moved | (keys & INPUT_EDGE_BITS);
+}
+
+// Simulated link -------------------------------------------------------------
+
+static void send_now(Netplay *n, const uint8_t *data, int len) {
+  sendto(n->sock, data, len, 0, (struct sockaddr *)&n->peer, sizeof(n->peer));
+}
+
+static void link_send(Netplay *n, const uint8_t *data, int len) {
+  const Netplay_Link *l = &n->config.link;
+  n->stats.packets_sent++;
+  if (l->loss > 0 && (rng_next(&n->link_rng) >> 40) / 16777216.0f < l->loss) {
+    n->stats.packets_dropped++;
+    return;
+  }
+  if (l->delay_ms <= 0 && l->jitter_ms <= 0) {
+    send_now(n, data, len);
+    return;
+  }
+  if (n->queue_cnt == NETPLAY_QUEUE) {
+    n->stats.packets_dropped++;
+    return;
+  }
+  int delay_us = l->delay_ms * 1000;
+  if (l->jitter_ms > 0)
+    delay_us += rng_range(&n->link_rng, 0, l->jitter_ms * 1000);
+  Netplay_Packet *p = &n->queue[n->queue_cnt++];
+  p->due_ns = profile_now_ns() + (uint64_t)delay_us * 1000;
+  p->len = len;
+  memcpy(p->data, data, len);
+}
+
+static void link_flush(Netplay *n) {
+  uint64_t now = profile_now_ns();
+  int kept = 0;
+  for (int i = 0; i < n->queue_cnt; i++) {
+    Netplay_Packet *p = &n->queue[i];
+    if (p->due_ns <= now)
+      send_now(n, p->data, p->len);
+    else if (kept != i)
+      n->queue[kept++] = *p;
+    else
+      kept++;
+  }
+  n->queue_cnt = kept;
+}
+
+// Rollback -------------------------------------------------------------------
+
+static void start_match(Netplay *n) {
+  init_state(&n->state, n->seed);
+  n->state.step = Step_Running;
+  n->state.pause = false;
+  n->tick = 0;
+  // Ticks before the input delay runs out play with no keys held.
+  memset(n->local_inputs, 0, sizeof(n->local_inputs));
+  n->local_cnt = n->config.input_delay;
+  n->next_check = NETPLAY_CHECK_INTERVAL;
+  n->last_wait_tick = UINT32_MAX;
+  n->ready = true;
+}
+
+static Input remote_input(const Netplay *n, uint32_t tick) {
+  uint32_t slot = tick % NETPLAY_RING;
+  if (n->remote_known[slot] == tick + 1)
+    return n->remote_inputs[slot];
+  // Predict the keys held last; events don't repeat.
+  if (n->remote_confirmed == 0)
+    return 0;
+  return n->remote_inputs[(n->remote_confirmed - 1) % NETPLAY_RING] &
+         ~INPUT_EDGE_BITS;
+}
+
+static void simulate_tick(Netplay *n) {
+  uint32_t slot = n->tick % NETPLAY_RING;
+  Input remote = remote_input(n, n->tick);
+  n->snapshots[slot] = n->state;
+  n->used_remote[slot] = remote;
+  update_state(&n->state, n->local_inputs[slot] | remote, TICK_DELTA);
+  n->tick++;
+}
+
+static void roll_back(Netplay *n) {
+  uint32_t end = n->tick;
+  int depth = end - n->rollback_from;
+  n->state = n->snapshots[n->rollback_from % NETPLAY_RING];
+  n->tick = n->rollback_from;
+  while (n->tick < end)
+    simulate_tick(n);
+  n->rollback = false;
+  n->stats.rollbacks++;
+  n->stats.resimulated_ticks += depth;
+  if (depth > n->stats.max_rollback)
+    n->stats.max_rollback = depth;
+}
+
+// Desync checks --------------------------------------------------------------
+
+static void compare_check(Netplay *n) {
+  Netplay_Check remote = n->remote_check;
+  if (remote.tick <= n->checked_tick)
+    return;
+  Netplay_Check *local =
+      &n->checks[remote.tick / NETPLAY_CHECK_INTERVAL % NETPLAY_CHECK_SLOTS];
+  if (local->tick != remote.tick)
+    return;
+  n->stats.checks++;
+  if (local->sum != remote.sum) {
+    n->stats.desyncs++;
+    fprintf(stderr, "netplay: desync at tick %u\n", remote.tick);
+  }
+  n->checked_tick = remote.tick;
+}
+
+// Checksums the snapshots that can no longer change: every input before them
+// is confirmed.
+static void update_checks(Netplay *n) {
+  while (n->next_check < n->tick && n->next_check <= n->remote_confirmed) {
+    if (n->tick - n->next_check < NETPLAY_RING) {
+      Netplay_Check *c = &n->checks[n->next_check / NETPLAY_CHECK_INTERVAL %
+                                    NETPLAY_CHECK_SLOTS];
+      c->tick = n->next_check;
+      c->sum = netplay_checksum(&n->snapshots[n->next_check % NETPLAY_RING]);
+    }
+    n->next_check += NETPLAY_CHECK_INTERVAL;
+  }
+  compare_check(n);
+}
+
+static Netplay_Check latest_check(const Netplay *n) {
+  Netplay_Check none = {0, 0};
+  if (n->next_check <= NETPLAY_CHECK_INTERVAL)
+    return none;
+  uint32_t tick = n->next_check - NETPLAY_CHECK_INTERVAL;
+  const Netplay_Check *c =
+      &n->checks[tick / NETPLAY_CHECK_INTERVAL % NETPLAY_CHECK_SLOTS];
+  return c->tick == tick ? *c : none;
+}
+
+// Packets --------------------------------------------------------------------
+
+static uint8_t *put_header(uint8_t *p, Packet_Type type) {
+  *p++ = 'P';
+  *p++ = 'N';
+  *p++ = NETPLAY_VERSION;
+  *p++ = type;
+  return p;
+}
+
+static void send_hello(Netplay *n) {
+  uint8_t packet[12];
+  uint8_t *p = put_header(packet, Packet_Hello);
+  put_u64(p, n->seed);
+  link_send(n, packet, sizeof(packet));
+  n->last_hello_ns = profile_now_ns();
+}
+
+static void send_inputs(Netplay *n) {
+  uint8_t packet[INPUT_HEADER_SIZE + MAX_PACKET_INPUTS * 4];
+  uint32_t first = n->peer_ack;
+  uint32_t count = n->local_cnt - first;
+  if (count > MAX_PACKET_INPUTS)
+    count = MAX_PACKET_INPUTS;
+  Netplay_Check check = latest_check(n);
+
+  uint8_t *p = put_header(packet, Packet_Input);
+  p = put_u32(p, first);
+  p = put_u32(p, n->remote_confirmed);
+  p = put_u32(p, (uint32_t)(int32_t)(n->tick - n->remote_confirmed));
+  p = put_u32(p, check.tick);
+  p = put_u32(p, check.sum);
+  *p++ = count;
+  for (uint32_t i = 0; i < count; i++)
+    p = put_u32(p, n->local_inputs[(first + i) % NETPLAY_RING]);
+  link_send(n, packet, p - packet);
+  n->last_send_ns = profile_now_ns();
+}
+
+static void read_inputs(Netplay *n, const uint8_t *p, int len) {
+  uint32_t first, ack, advantage;
+  Netplay_Check check;
+  if (len < INPUT_HEADER_SIZE)
+    return;
+  p = get_u32(p, &first);
+  p = get_u32(p, &ack);
+  p = get_u32(p, &advantage);
+  p = get_u32(p, &check.tick);
+  p = get_u32(p, &check.sum);
+  uint32_t count = *p++;
+  if (len < INPUT_HEADER_SIZE + (int)count * 4)
+    return;
+
+  if (ack > n->peer_ack && ack <= n->local_cnt)
+    n->peer_ack = ack;
+  n->remote_advantage = (int32_t)advantage;
+  if (check.tick > n->remote_check.tick)
+    n->remote_check = check;
+
+  Side remote_side = n->side == Side_Left ? Side_Right : Side_Left;
+  Input allowed = ai_side_mask(remote_side) | INPUT_EDGE_BITS;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t tick = first + i;
+    Input input;
+    p = get_u32(p, &input);
+    if (tick < n->remote_confirmed)
+      continue;
+    if (tick >= n->remote_confirmed + NETPLAY_RING)
+      break;
+    n->remote_inputs[tick % NETPLAY_RING] = input & allowed;
+    n->remote_known[tick % NETPLAY_RING] = tick + 1;
+  }
+
+  while (n->remote_known[n->remote_confirmed % NETPLAY_RING] ==
+         n->remote_confirmed + 1) {
+    uint32_t tick = n->remote_confirmed;
+    uint32_t slot = tick % NETPLAY_RING;
+    if (tick < n->tick && n->remote_inputs[slot] != n->used_remote[slot] &&
+        (!n->rollback || tick < n->rollback_from)) {
+      n->rollback = true;
+      n->rollback_from = tick;
+    }
+    n->remote_confirmed++;
+  }
+}
+
+static bool from_peer(const Netplay *n, const struct sockaddr_in *from) {
+  return from->sin_addr.s_addr == n->peer.sin_addr.s_addr &&
+         from->sin_port == n->peer.sin_port;
+}
+
+void netplay_poll(Netplay *n) {
+  uint64_t now = profile_now_ns();
+  if (!n->host && !n->ready && now - n->last_hello_ns >= HELLO_INTERVAL_NS)
+    send_hello(n);
+  link_flush(n);
+
+  uint8_t packet[NETPLAY_MAX_PACKET];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  int len;
+  while ((len = recvfrom(n->sock, packet, sizeof(packet), 0,
+                         (struct sockaddr *)&from, &from_len)) > 0) {
+    from_len = sizeof(from);
+    if (len < 4 || packet[0] != 'P' || packet[1] != 'N' ||
+        packet[2] != NETPLAY_VERSION)
+      continue;
+    if (n->host && !n->has_peer && packet[3] == Packet_Hello) {
+      n->peer = from;
+      n->has_peer = true;
+    }
+    if (!n->has_peer || !from_peer(n, &from))
+      continue;
+    n->stats.packets_received++;
+
+    if (packet[3] == Packet_Hello && len >= 12) {
+      if (n->host) {
+        // Answer every hello, the first answer may be lost.
+        send_hello(n);
+        if (!n->ready)
+          start_match(n);
+      } else if (!n->ready) {
+        get_u64(packet + 4, &n->seed);
+        start_match(n);
+      }
+    } else if (packet[3] == Packet_Input && n->ready) {
+      read_inputs(n, packet + 4, len);
+    }
+  }
+
+  if (n->rollback)
+    roll_back(n);
+  if (n->ready) {
+    update_checks(n);
+    // Keep acks flowing while we have nothing new to say.
+    if (now - n->last_send_ns >= 1000000000ull / TICK_RATE)
+      send_inputs(n);
+  }
+}
+
+bool netplay_advance(Netplay *n, Input local) {
+  if (!n->ready)
+    return false;
+
+  // Too far ahead to roll back to the peer's last input, or to keep our
+  // unacknowledged inputs around.
+  if (n->tick >= n->remote_confirmed + NETPLAY_MAX_ROLLBACK ||
+      n->local_cnt - n->peer_ack >= NETPLAY_RING - NETPLAY_MAX_INPUT_DELAY) {
+    n->stats.stalls++;
+    send_inputs(n);
+    return false;
+  }
+  // Both sides report how far they run ahead of the other's inputs; the one
+  // further ahead skips a tick now and then so rollbacks stay short.
+  int advantage = n->tick - n->remote_confirmed;
+  if (advantage - n->remote_advantage >= SYNC_THRESHOLD &&
+      n->last_wait_tick != n->tick && n->tick % 8 == 0) {
+    n->last_wait_tick = n->tick;
+    n->stats.sync_waits++;
+    return false;
+  }
+
+  Side remote_side = n->side == Side_Left ? Side_Right : Side_Left;
+  local &= ~ai_side_mask(remote_side);
+  n->local_inputs[n->local_cnt % NETPLAY_RING] = local;
+  n->local_cnt++;
+  simulate_tick(n);
+  send_inputs(n);
+  update_checks(n);
+  return true;
+}
+
+void netplay_print_stats(const Netplay *n, FILE *f) {
+  const Netplay_Stats *st = &n->stats;
+  fprintf(f,
+          "netplay %s: %u ticks, %llu rollbacks (%llu ticks resimulated, "
+          "deepest %d), %llu stalls, %llu sync waits, %llu/%llu packets "
+          "sent/received, %llu dropped, %llu checks, %llu desyncs\n",
+          n->host ? "host" : "guest", n->tick,
+          (unsigned long long)st->rollbacks,
+          (unsigned long long)st->resimulated_ticks, st->max_rollback,
+          (unsigned long long)st->stalls, (unsigned long long)st->sync_waits,
+          (unsigned long long)st->packets_sent,
+          (unsigned long long)st->packets_received,
+          (unsigned long long)st->packets_dropped,
+          (unsigned long long)st->checks, (unsigned long long)st->desyncs);
+}
@@ -0,0 +1,129 @@
+#ifndef PONG_NETPLAY_H
+#define PONG_NETPLAY_H
+
+// Peer-to-peer rollback netplay over UDP. Each peer plays one paddle: the
+// host the left, the peer that joins the right. Local input is applied right
+// away (after input_delay ticks) and sent to the other peer; the remote
+// paddle runs on a prediction, the last input we got from it. When the real
+// input arrives and differs, the match rolls back to the snapshot taken
+// before that tick and re-simulates up to now.
+//
+// Every packet repeats all inputs the peer hasn't acknowledged, so lost
+// packets need no retransmission. Outgoing packets can be put through a
+// simulated link with delay, jitter and loss to try it over loopback.
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ai.h"
+#include "sim.h"
+
+#define NETPLAY_RING 128         // snapshots and inputs kept, in ticks
+#define NETPLAY_MAX_ROLLBACK 40  // stall rather than predict further ahead
+#define NETPLAY_MAX_INPUT_DELAY 8
+#define NETPLAY_MAX_PACKET 320
+#define NETPLAY_QUEUE 256        // packets held back by the simulated link
+#define NETPLAY_CHECK_INTERVAL 60 // ticks between desync checksums
+#define NETPLAY_CHECK_SLOTS 8
+
+typedef struct {
+  int delay_ms;  // one way, added to every outgoing packet
+  int jitter_ms; // plus up to this much, uniformly
+  float loss;    // fraction of outgoing packets dropped
+} Netplay_Link;
+
+typedef struct {
+  int input_delay; // ticks before local input takes effect
+  Netplay_Link link;
+  uint64_t link_seed;
+} Netplay_Config;
+
+typedef struct {
+  uint64_t due_ns;
+  int len;
+  uint8_t data[NETPLAY_MAX_PACKET];
+} Netplay_Packet;
+
+typedef struct {
+  uint64_t rollbacks;
+  uint64_t resimulated_ticks;
+  int max_rollback;        // deepest rollback, in ticks
+  uint64_t stalls;         // advances refused, too far ahead of the peer
+  uint64_t sync_waits;     // advances skipped to let the peer catch up
+  uint64_t packets_sent;
+  uint64_t packets_dropped; // by the simulated link
+  uint64_t packets_received;
+  uint64_t checks;
+  uint64_t desyncs;
+} Netplay_Stats;
+
+typedef struct {
+  uint32_t tick;
+  uint32_t sum;
+} Netplay_Check;
+
+typedef struct {
+  Netplay_Config config;
+  Side side;
+  bool host;
+  int sock;
+  struct sockaddr_in peer;
+  bool has_peer;
+  bool ready; // both sides agreed on the seed
+  uint64_t seed;
+  uint64_t last_hello_ns;
+
+  State state;   // as of tick, speculative past remote_confirmed
+  uint32_t tick; // next tick to simulate
+  State snapshots[NETPLAY_RING]; // state at the start of each tick
+  Input local_inputs[NETPLAY_RING];
+  Input remote_inputs[NETPLAY_RING];
+  uint32_t remote_known[NETPLAY_RING]; // tick + 1 when remote_inputs has it
+  Input used_remote[NETPLAY_RING];     // what the simulation assumed
+  uint32_t local_cnt;        // local inputs exist for [0, local_cnt)
+  uint32_t remote_confirmed; // remote inputs known for [0, remote_confirmed)
+  uint32_t peer_ack;         // the peer has ours for [0, peer_ack)
+  uint32_t rollback_from;    // earliest mispredicted tick, if rollback
+  bool rollback;
+  int remote_advantage; // how far the peer runs ahead of our inputs
+  uint32_t last_wait_tick;
+  uint64_t last_send_ns;
+
+  Netplay_Check checks[NETPLAY_CHECK_SLOTS];
+  Netplay_Check remote_check; // newest the peer sent
+  uint32_t checked_tick;      // newest compared
+  uint32_t next_check;
+
+  Rng link_rng;
+  Netplay_Packet queue[NETPLAY_QUEUE];
+  int queue_cnt;
+  Netplay_Stats stats;
+} Netplay;
+
+void init_netplay_config(Netplay_Config *c);
+// Waits on UDP `port` for a peer to join; the match uses `seed`.
+bool netplay_host(Netplay *n, uint16_t port, uint64_t seed,
+                  const Netplay_Config *c);
+// `address` is HOST:PORT of a hosting peer.
+bool netplay_join(Netplay *n, const char *address, const Netplay_Config *c);
+void netplay_close(Netplay *n);
+// The UDP port we are bound to, for hosts started on port 0.
+uint16_t netplay_local_port(const Netplay *n);
+
+// Sends what the simulated link has let through, reads the peer's packets
+// and rolls back if a prediction turned out wrong. Call at least once per
+// frame, also while not ready.
+void netplay_poll(Netplay *n);
+// Simulates one tick with `local` on our paddle. Returns false when the tick
+// was held back instead: not ready yet, too far ahead of the peer, or
+// slowing down so the peer can catch up.
+bool netplay_advance(Netplay *n, Input local);
+// Moves whichever paddle keys `keys` has onto `side`, so either key set
+// plays the local paddle.
+Input netplay_side_input(Side side, Input keys);
+uint32_t netplay_checksum(const State *s);
+void netplay_print_stats(const Netplay *n, FILE *f);
+
+#endif
@@ -0,0 +1,141 @@
+#include "pacing.h"
+
+#include <errno.h>
+#include <math.h>
+#include <raylib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+#define PACING_SPIN_MIN_NS 200000 // hybrid always spins at least this long
+
+const char *limiter_names[Limiter_Cnt] = {
+    [Limiter_Uncapped] = "uncapped",
+    [Limiter_Vsync] = "vsync",
+    [Limiter_Sleep] = "sleep",
+    [Limiter_Hybrid] = "hybrid",
+};
+
+const char *idle_mode_names[Idle_Mode_Cnt] = {
+    [Idle_Mode_Wait] = "wait",
+    [Idle_Mode_Cap] = "cap",
+    [Idle_Mode_Off] = "off",
+};
+
+void init_pacing_config(Pacing_Config *c) {
+  c->limiter = Limiter_Uncapped;
+  c->target_fps = 0;
+  c->idle_mode = Idle_Mode_Wait;
+}
+
+bool parse_limiter(const char *name, Limiter *out) {
+  for (int i = 0; i < Limiter_Cnt; i++) {
+    if (strcmp(name, limiter_names[i]) == 0) {
+      *out = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parse_idle_mode(const char *name, Idle_Mode *out) {
+  for (int i = 0; i < Idle_Mode_Cnt; i++) {
+    if (strcmp(name, idle_mode_names[i]) == 0) {
+      *out = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void pacer_init(Pacer *p, const Pacing_Config *c) {
+  memset(p, 0, sizeof(*p));
+  p->config = *c;
+  bool capped = c->limiter == Limiter_Sleep || c->limiter == Limiter_Hybrid;
+  if (!capped)
+    p->config.target_fps = 0;
+  else if (p->config.target_fps <= 0)
+    p->config.target_fps = PACING_DEFAULT_FPS;
+  if (c->limiter == Limiter_Vsync)
+    SetConfigFlags(FLAG_VSYNC_HINT);
+  SetTargetFPS(0);
+}
+
+void pacer_set_idle(Pacer *p, bool idle) {
+  if (p->config.idle_mode == Idle_Mode_Off || p->idle == idle)
+    return;
+
+  p->idle = idle;
+  p->last_frame_ns = 0; // don't count the transition in the jitter stats
+  if (p->config.idle_mode == Idle_Mode_Wait) {
+    if (idle)
+      EnableEventWaiting();
+    else
+      DisableEventWaiting();
+  }
+}
+
+static void sleep_until(uint64_t ns) {
+  struct timespec ts = {ns / 1000000000ull, ns % 1000000000ull};
+  // Only a signal is worth retrying; anything else would fail forever.
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+static void hybrid_wait(Pacer *p, uint64_t deadline) {
+  uint64_t margin = 2 * p->oversleep_ns + PACING_SPIN_MIN_NS;
+  uint64_t now = profile_now_ns();
+  if (deadline > now + margin) {
+    uint64_t wake = deadline - margin;
+    sleep_until(wake);
+    // Track how late the scheduler wakes us, decaying towards new values.
+    uint64_t late = profile_now_ns() - wake;
+    p->oversleep_ns = (p->oversleep_ns * 7 + late) / 8;
+  }
+  while (profile_now_ns() < deadline) {
+  }
+}
+
+void pacer_wait(Pacer *p) {
+  bool idle_cap = p->idle && p->config.idle_mode == Idle_Mode_Cap;
+  Limiter limiter = idle_cap ? Limiter_Sleep : p->config.limiter;
+  if (limiter == Limiter_Uncapped || limiter == Limiter_Vsync)
+    return;
+
+  int fps = idle_cap ? IDLE_FPS : p->config.target_fps;
+  uint64_t period = 1000000000ull / fps;
+  uint64_t now = profile_now_ns();
+  // Schedule on a fixed grid so errors don't accumulate, but start over
+  // after a stall instead of rushing frames out to catch up.
+  p->deadline_ns += period;
+  if (p->deadline_ns + period < now || p->deadline_ns > now + period)
+    p->deadline_ns = now + period;
+
+  uint64_t t = profile_begin();
+  if (limiter == Limiter_Sleep)
+    sleep_until(p->deadline_ns);
+  else
+    hybrid_wait(p, p->deadline_ns);
+  profile_end(Profile_Zone_Frame_Wait, t);
+}
+
+void pacer_frame_presented(Pacer *p) {
+  uint64_t now = profile_now_ns();
+  if (p->last_frame_ns != 0 && !p->idle) {
+    double interval = now - p->last_frame_ns;
+    p->interval_cnt++;
+    double delta = interval - p->interval_mean_ns;
+    p->interval_mean_ns += delta / p->interval_cnt;
+    p->interval_m2 += delta * (interval - p->interval_mean_ns);
+  }
+  p->last_frame_ns = now;
+}
+
+double pacer_jitter_ms(const Pacer *p) {
+  if (p->interval_cnt < 2)
+    return 0.0;
+  return sqrt(p->interval_m2 / (p->interval_cnt - 1)) / 1e6;
+}
+
+double pacer_mean_frame_ms(const Pacer *p) { return p->interval_mean_ns / 1e6; }
@@ -0,0 +1,75 @@
+#ifndef PONG_PACING_H
+#define PONG_PACING_H
+
+// Frame pacing for the windowed modes.
+//
+// The limiter picks how a frame waits for its slot: not at all, on the
+// swap (vsync), in a sleep, or in a sleep that wakes early and spins the
+// rest of the way. raylib's own SetTargetFPS stays at 0; the pacer does the
+// waiting right before EndDrawing, so the input poll in EndDrawing still
+// happens right after the swap.
+//
+// While nothing on screen can move (menus, the win screen, a paused match)
+// the loop stops spinning: it either blocks in EndDrawing until an input
+// event arrives or drops to IDLE_FPS.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IDLE_FPS 10
+#define PACING_DEFAULT_FPS 144 // for sleep and hybrid when --fps is not given
+
+typedef enum {
+  Limiter_Uncapped,
+  Limiter_Vsync,
+  Limiter_Sleep,
+  Limiter_Hybrid, // sleep, then spin for the last stretch
+  Limiter_Cnt,
+} Limiter;
+
+typedef enum {
+  Idle_Mode_Wait, // block on input events
+  Idle_Mode_Cap,  // sleep down to IDLE_FPS
+  Idle_Mode_Off,  // always run at the limiter's rate
+  Idle_Mode_Cnt,
+} Idle_Mode;
+
+typedef struct {
+  Limiter limiter;
+  int target_fps; // sleep and hybrid only, 0 picks PACING_DEFAULT_FPS
+  Idle_Mode idle_mode;
+} Pacing_Config;
+
+typedef struct {
+  Pacing_Config config;
+  bool idle;
+  uint64_t deadline_ns;   // when the current frame should be presented
+  uint64_t oversleep_ns;  // running estimate of how late sleeps wake
+  uint64_t last_frame_ns; // previous pacer_frame_presented
+  // Frame-to-frame intervals of non-idle frames, for the jitter report.
+  uint64_t interval_cnt;
+  double interval_mean_ns;
+  double interval_m2; // sum of squared deviations (Welford)
+} Pacer;
+
+extern const char *limiter_names[Limiter_Cnt];
+extern const char *idle_mode_names[Idle_Mode_Cnt];
+
+void init_pacing_config(Pacing_Config *c);
+bool parse_limiter(const char *name, Limiter *out);
+bool parse_idle_mode(const char *name, Idle_Mode *out);
+
+// Call before InitWindow, the vsync hint only applies to new windows.
+void pacer_init(Pacer *p, const Pacing_Config *c);
+// Switches between full-rate and idle pacing; cheap when nothing changes.
+void pacer_set_idle(Pacer *p, bool idle);
+// Waits for the frame's slot. Call right before EndDrawing.
+void pacer_wait(Pacer *p);
+// Call right after EndDrawing to record the frame interval.
+void pacer_frame_presented(Pacer *p);
+
+// Standard deviation of the frame interval in milliseconds.
+double pacer_jitter_ms(const Pacer *p);
+double pacer_mean_frame_ms(const Pacer *p);
+
+#endif
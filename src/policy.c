@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+
+#include "policy.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bytes.h"
+
+#define POLICY_HELLO "PONGPOL" // followed by the version byte
+
+static bool write_full(int fd, const uint8_t *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return false;
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+static bool read_full(int fd, uint8_t *p, size_t n) {
+  while (n > 0) {
+    ssize_t r = read(fd, p, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+static bool open_library(Policy *p, const char *spec) {
+  // The path ends at the first space, the rest is passed to create().
+  char path[4096];
+  const char *args = strchr(spec, ' ');
+  size_t len = args ? (size_t)(args - spec) : strlen(spec);
+  if (len >= sizeof(path))
+    return false;
+  memcpy(path, spec, len);
+  path[len] = '\0';
+  args = args ? args + 1 : "";
+
+  p->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!p->library) {
+    fprintf(stderr, "policy: %s\n", dlerror());
+    return false;
+  }
+  Pong_Policy_Entry entry =
+      (Pong_Policy_Entry)dlsym(p->library, PONG_POLICY_ENTRY);
+  p->api = entry ? entry() : NULL;
+  if (!p->api || p->api->abi_version != PONG_POLICY_ABI_VERSION) {
+    fprintf(stderr, "policy: %s has no compatible %s\n", path,
+            PONG_POLICY_ENTRY);
+    dlclose(p->library);
+    return false;
+  }
+  p->instance = p->api->create(args);
+  if (!p->instance) {
+    fprintf(stderr, "policy: %s failed to create a policy\n", path);
+    dlclose(p->library);
+    return false;
+  }
+  return true;
+}
+
+static bool spawn_process(Policy *p, const char *command) {
+  // Close-on-exec, or children spawned later (by other batch threads too)
+  // keep this child's stdin open and it never sees EOF. dup2 clears the flag
+  // on the child's own stdin and stdout.
+  int to_child[2], from_child[2];
+  if (pipe2(to_child, O_CLOEXEC) != 0)
+    return false;
+  if (pipe2(from_child, O_CLOEXEC) != 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    return false;
+  }
+
+  p->pid = fork();
+  if (p->pid == 0) {
+    dup2(to_child[0], STDIN_FILENO);
+    dup2(from_child[1], STDOUT_FILENO);
+    close(to_child[0]);
+    close(to_child[1]);
+    close(from_child[0]);
+    close(from_child[1]);
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+  close(to_child[0]);
+  close(from_child[1]);
+  if (p->pid < 0) {
+    close(to_child[1]);
+    close(from_child[0]);
+    return false;
+  }
+  p->write_fd = to_child[1];
+  p->read_fd = from_child[0];
+  return true;
+}
+
+static bool connect_socket(Policy *p, const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path))
+    return false;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return false;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+  p->read_fd = fd;
+  p->write_fd = fd;
+  return true;
+}
+
+static bool handshake(Policy *p) {
+  uint8_t hello[8];
+  memcpy(hello, POLICY_HELLO, 7);
+  hello[7] = PONG_POLICY_ABI_VERSION;
+  uint8_t version;
+  if (!write_full(p->write_fd, hello, sizeof(hello)) ||
+      !read_full(p->read_fd, &version, 1))
+    return false;
+  if (version != PONG_POLICY_ABI_VERSION) {
+    fprintf(stderr, "policy: speaks version %d, need %d\n", version,
+            PONG_POLICY_ABI_VERSION);
+    return false;
+  }
+  return true;
+}
+
+bool policy_open(Policy *p, const char *spec) {
+  memset(p, 0, sizeof(*p));
+  p->read_fd = -1;
+  p->write_fd = -1;
+  p->pid = -1;
+
+  if (strncmp(spec, "so:", 3) == 0) {
+    p->kind = Policy_Kind_Library;
+    return open_library(p, spec + 3);
+  }
+
+  bool ok;
+  if (strncmp(spec, "exec:", 5) == 0) {
+    p->kind = Policy_Kind_Process;
+    ok = spawn_process(p, spec + 5);
+  } else if (strncmp(spec, "unix:", 5) == 0) {
+    p->kind = Policy_Kind_Socket;
+    ok = connect_socket(p, spec + 5);
+  } else {
+    fprintf(stderr, "policy: unknown spec %s\n", spec);
+    return false;
+  }
+  // A policy that exits must fail the step, not kill us with SIGPIPE.
+  signal(SIGPIPE, SIG_IGN);
+  if (!ok || !handshake(p)) {
+    policy_close(p);
+    return false;
+  }
+  return true;
+}
+
+static uint8_t *put_observation(uint8_t *w, const Pong_Observation *o) {
+  w = put_f32(w, o->ball_x);
+  w = put_f32(w, o->ball_y);
+  w = put_f32(w, o->ball_vx);
+  w = put_f32(w, o->ball_vy);
+  w = put_f32(w, o->paddle_x);
+  w = put_f32(w, o->paddle_y);
+  w = put_f32(w, o->paddle_w);
+  w = put_f32(w, o->paddle_h);
+  w = put_f32(w, o->opponent_x);
+  w = put_f32(w, o->opponent_y);
+  w = put_f32(w, o->opponent_w);
+  w = put_f32(w, o->opponent_h);
+  w = put_f32(w, o->aspect_ratio);
+  w = put_u32(w, (uint32_t)o->side);
+  w = put_u32(w, (uint32_t)o->score);
+  w = put_u32(w, (uint32_t)o->opponent_score);
+  return w;
+}
+
+static bool step_wire(Policy *p, const Pong_Observation *obs,
+                      uint8_t *actions, uint32_t count) {
+  uint32_t size = 4 + count * PONG_OBSERVATION_WIRE_SIZE;
+  if (size > p->wire_cap) {
+    uint8_t *wire = realloc(p->wire, size);
+    if (!wire)
+      return false;
+    p->wire = wire;
+    p->wire_cap = size;
+  }
+
+  uint8_t *w = put_u32(p->wire, count);
+  for (uint32_t i = 0; i < count; i++)
+    w = put_observation(w, &obs[i]);
+  return write_full(p->write_fd, p->wire, size) &&
+         read_full(p->read_fd, actions, count);
+}
+
+bool policy_step(Policy *p, const Pong_Observation *obs, uint8_t *actions,
+                 uint32_t count) {
+  bool ok = true;
+  switch (p->kind) {
+  case Policy_Kind_Library:
+    p->api->step(p->instance, obs, actions, count);
+    break;
+  case Policy_Kind_Process:
+  case Policy_Kind_Socket:
+    ok = step_wire(p, obs, actions, count);
+    break;
+  }
+  if (!ok)
+    memset(actions, Pong_Action_None, count);
+  return ok;
+}
+
+void policy_close(Policy *p) {
+  if (p->library) {
+    if (p->api && p->instance)
+      p->api->destroy(p->instance);
+    dlclose(p->library);
+  }
+  if (p->write_fd >= 0)
+    close(p->write_fd);
+  if (p->read_fd >= 0 && p->read_fd != p->write_fd)
+    close(p->read_fd);
+  if (p->pid > 0)
+    waitpid(p->pid, NULL, 0);
+  free(p->wire);
+  memset(p, 0, sizeof(*p));
+  p->read_fd = -1;
+  p->write_fd = -1;
+  p->pid = -1;
+}
+
+void policy_observe(const Ball *ball, const Paddle *own,
+                    const Paddle *opponent, float aspect_ratio, Side side,
+                    int score, int opponent_score, Pong_Observation *out) {
+  out->ball_x = ball->x;
+  out->ball_y = ball->y;
+  out->ball_vx = ball->vx;
+  out->ball_vy = ball->vy;
+  out->paddle_x = own->x;
+  out->paddle_y = own->y;
+  out->paddle_w = own->w;
+  out->paddle_h = own->h;
+  out->opponent_x = opponent->x;
+  out->opponent_y = opponent->y;
+  out->opponent_w = opponent->w;
+  out->opponent_h = opponent->h;
+  out->aspect_ratio = aspect_ratio;
+  out->side = side;
+  out->score = score;
+  out->opponent_score = opponent_score;
+}
+
+void policy_observe_state(const State *s, Side side, Pong_Observation *out) {
+  if (side == Side_Left)
+    policy_observe(&s->ball, &s->left_paddle, &s->right_paddle,
+                   s->aspect_ratio, side, s->left_player_score,
+                   s->right_player_score, out);
+  else
+    policy_observe(&s->ball, &s->right_paddle, &s->left_paddle,
+                   s->aspect_ratio, side, s->right_player_score,
+                   s->left_player_score, out);
+}
+
+Input policy_action_input(Side side, uint8_t action) {
+  Input up = side == Side_Left ? Input_Left_Up : Input_Right_Up;
+  Input down = side == Side_Left ? Input_Left_Down : Input_Right_Down;
+  if (action == Pong_Action_Up)
+    return up;
+  if (action == Pong_Action_Down)
+    return down;
+  return 0;
+}
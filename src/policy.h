@@ -0,0 +1,50 @@
+#ifndef PONG_POLICY_H
+#define PONG_POLICY_H
+
+// Host side of policy_abi.h. A spec picks the transport:
+//   so:PATH [ARGS]  dlopen a shared library, ARGS go to its create()
+//   exec:COMMAND    run COMMAND through /bin/sh, talk over its stdin/stdout
+//   unix:PATH       connect to a policy listening on a Unix socket
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "ai.h"
+#include "policy_abi.h"
+#include "sim.h"
+
+typedef enum {
+  Policy_Kind_Library,
+  Policy_Kind_Process,
+  Policy_Kind_Socket,
+} Policy_Kind;
+
+typedef struct {
+  Policy_Kind kind;
+  // Library
+  void *library;
+  const Pong_Policy_Api *api;
+  void *instance;
+  // Process and socket
+  int read_fd;
+  int write_fd;
+  pid_t pid;
+  uint8_t *wire;
+  uint32_t wire_cap;
+} Policy;
+
+bool policy_open(Policy *p, const char *spec);
+// One batched call. On failure the actions are all Pong_Action_None.
+bool policy_step(Policy *p, const Pong_Observation *obs, uint8_t *actions,
+                 uint32_t count);
+void policy_close(Policy *p);
+
+void policy_observe(const Ball *ball, const Paddle *own,
+                    const Paddle *opponent, float aspect_ratio, Side side,
+                    int score, int opponent_score, Pong_Observation *out);
+void policy_observe_state(const State *s, Side side, Pong_Observation *out);
+// The Input bits for `side` that carry out `action`.
+Input policy_action_input(Side side, uint8_t action);
+
+#endif
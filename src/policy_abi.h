@@ -0,0 +1,67 @@
+#ifndef PONG_POLICY_ABI_H
+#define PONG_POLICY_ABI_H
+
+// Stable interface for external paddle controllers. This header is the
+// whole contract: it depends on nothing else in the tree, and fields are only
+// ever appended behind a version bump.
+//
+// Every call hands over a batch of observations, one per paddle to move
+// (usually one per match), and gets back one action per observation.
+//
+// Shared library: export pong_policy_api() returning a Pong_Policy_Api.
+//
+// Pipe or Unix socket: the host opens with the 8 bytes "PONGPOL" followed by
+// PONG_POLICY_ABI_VERSION as one byte, and the policy answers with the
+// version byte it speaks. Then, for each step:
+//   host -> policy: u32 count, count * PONG_OBSERVATION_WIRE_SIZE bytes
+//   policy -> host: count action bytes
+// Integers and floats are little-endian; an observation goes over the wire
+// as its fields in declaration order, 4 bytes each.
+
+#include <stdint.h>
+
+#define PONG_POLICY_ABI_VERSION 1
+#define PONG_OBSERVATION_WIRE_SIZE 64
+
+// Positions and sizes are fractions of the screen: x of its width, y of its
+// height. Velocities are per second, vx in widths per height, so the ball
+// really moves vx * aspect_ratio widths per second.
+typedef struct {
+  float ball_x;
+  float ball_y;
+  float ball_vx;
+  float ball_vy;
+  float paddle_x; // the paddle this observation asks an action for
+  float paddle_y;
+  float paddle_w;
+  float paddle_h;
+  float opponent_x;
+  float opponent_y;
+  float opponent_w;
+  float opponent_h;
+  float aspect_ratio;
+  int32_t side; // 0 left, 1 right
+  int32_t score;
+  int32_t opponent_score;
+} Pong_Observation;
+
+typedef enum {
+  Pong_Action_None = 0,
+  Pong_Action_Up = 1,
+  Pong_Action_Down = 2,
+} Pong_Action;
+
+typedef struct {
+  uint32_t abi_version; // PONG_POLICY_ABI_VERSION the library was built with
+  // args is the text after the library path, "" if none.
+  void *(*create)(const char *args);
+  // actions[i] is a Pong_Action for obs[i].
+  void (*step)(void *policy, const Pong_Observation *obs, uint8_t *actions,
+               uint32_t count);
+  void (*destroy)(void *policy);
+} Pong_Policy_Api;
+
+typedef const Pong_Policy_Api *(*Pong_Policy_Entry)(void);
+#define PONG_POLICY_ENTRY "pong_policy_api"
+
+#endif
@@ -0,0 +1,92 @@
+#include "profile.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+Profile_Ring profile_ring;
+thread_local bool profile_active = false;
+
+const char *profile_zone_names[Profile_Zone_Cnt] = {
+    [Profile_Zone_Frame] = "frame",
+    [Profile_Zone_Input] = "input",
+    [Profile_Zone_Update_State] = "update_state",
+    [Profile_Zone_Update_Ball] = "update_ball",
+    [Profile_Zone_Draw] = "draw",
+    [Profile_Zone_Draw_Game] = "draw_game",
+    [Profile_Zone_Draw_Main_Menu] = "draw_main_menu",
+    [Profile_Zone_Draw_Win_Screen] = "draw_win_screen",
+    [Profile_Zone_Frame_Wait] = "frame_wait",
+    [Profile_Zone_End_Drawing] = "EndDrawing",
+};
+
+static thread_local Profile_Frame current;
+
+uint64_t profile_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void profile_enable(void) { profile_active = true; }
+
+void profile_end(Profile_Zone zone, uint64_t begin_ns) {
+  if (!profile_active)
+    return;
+
+  uint64_t end_ns = profile_now_ns();
+  current.zone_ns[zone] += end_ns - begin_ns;
+  if (current.span_cnt < PROFILE_MAX_SPANS) {
+    Profile_Span *span = &current.spans[current.span_cnt++];
+    span->zone = zone;
+    span->begin_ns = begin_ns;
+    span->end_ns = end_ns;
+  }
+}
+
+void profile_frame_begin(void) {
+  if (!profile_active)
+    return;
+
+  memset(current.zone_ns, 0, sizeof(current.zone_ns));
+  current.span_cnt = 0;
+  current.begin_ns = profile_now_ns();
+}
+
+void profile_frame_end(void) {
+  if (!profile_active)
+    return;
+
+  current.end_ns = profile_now_ns();
+  current.zone_ns[Profile_Zone_Frame] = current.end_ns - current.begin_ns;
+
+  uint64_t head =
+      atomic_load_explicit(&profile_ring.head, memory_order_relaxed);
+  current.index = head;
+  Profile_Frame *slot = &profile_ring.frames[head % PROFILE_RING_SIZE];
+  memcpy(slot, &current,
+         offsetof(Profile_Frame, spans) +
+             current.span_cnt * sizeof(Profile_Span));
+  atomic_store_explicit(&profile_ring.head, head + 1, memory_order_release);
+}
+
+bool profile_read_frame(uint64_t index, Profile_Frame *out) {
+  uint64_t head =
+      atomic_load_explicit(&profile_ring.head, memory_order_acquire);
+  if (index >= head || head - index > PROFILE_RING_SIZE)
+    return false;
+
+  const Profile_Frame *slot = &profile_ring.frames[index % PROFILE_RING_SIZE];
+  memcpy(out, slot, offsetof(Profile_Frame, spans));
+  uint32_t span_cnt = out->span_cnt;
+  if (span_cnt > PROFILE_MAX_SPANS)
+    span_cnt = PROFILE_MAX_SPANS;
+  memcpy(out->spans, slot->spans, span_cnt * sizeof(Profile_Span));
+
+  // The producer may have lapped us while copying; if the slot could have
+  // been reused, throw the copy away. The slot being rewritten is the one
+  // at head, so one frame of slack is enough.
+  atomic_thread_fence(memory_order_acquire);
+  head = atomic_load_explicit(&profile_ring.head, memory_order_relaxed);
+  return head - index < PROFILE_RING_SIZE && out->index == index;
+}
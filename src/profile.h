@@ -0,0 +1,74 @@
+#ifndef PONG_PROFILE_H
+#define PONG_PROFILE_H
+
+// Scoped frame timers. Each thread collects spans for its current frame;
+// profile_frame_end publishes the frame into a single-producer ring that any
+// number of readers can follow without locks. Timing is off unless the
+// thread called profile_enable, so the simulation hooks cost one branch in
+// the batch runner and the server.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
+
+#define PROFILE_RING_SIZE 512 // frames, power of two
+#define PROFILE_MAX_SPANS 64  // per frame, later spans only count in totals
+
+typedef enum {
+  Profile_Zone_Frame,
+  Profile_Zone_Input,
+  Profile_Zone_Update_State,
+  Profile_Zone_Update_Ball,
+  Profile_Zone_Draw,
+  Profile_Zone_Draw_Game,
+  Profile_Zone_Draw_Main_Menu,
+  Profile_Zone_Draw_Win_Screen,
+  Profile_Zone_Frame_Wait,  // frame limiter sleep/spin
+  Profile_Zone_End_Drawing, // buffer swap, event poll, vsync and idle waits
+  Profile_Zone_Cnt,
+} Profile_Zone;
+
+typedef struct {
+  Profile_Zone zone;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+} Profile_Span;
+
+typedef struct {
+  uint64_t index;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+  uint64_t zone_ns[Profile_Zone_Cnt];
+  uint32_t span_cnt;
+  Profile_Span spans[PROFILE_MAX_SPANS];
+} Profile_Frame;
+
+typedef struct {
+  Profile_Frame frames[PROFILE_RING_SIZE];
+  atomic_uint_least64_t head; // frames published so far
+} Profile_Ring;
+
+extern Profile_Ring profile_ring;
+extern thread_local bool profile_active;
+extern const char *profile_zone_names[Profile_Zone_Cnt];
+
+uint64_t profile_now_ns(void);
+
+// Makes the calling thread the producer of profile_ring.
+void profile_enable(void);
+
+// Returns a start stamp for profile_end, 0 when profiling is off.
+static inline uint64_t profile_begin(void) {
+  return profile_active ? profile_now_ns() : 0;
+}
+void profile_end(Profile_Zone zone, uint64_t begin_ns);
+
+void profile_frame_begin(void);
+void profile_frame_end(void);
+
+// Copies frame `index` out of the ring. Fails if it was not published yet
+// or has already been overwritten.
+bool profile_read_frame(uint64_t index, Profile_Frame *out);
+
+#endif
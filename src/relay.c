@@ -0,0 +1,499 @@
+// Spectator relay. One publisher (pong --publish, or loadgen --relay
+// --publish) streams a match as broadcast.h frames; the relay appends them
+// once to a shared byte ring and every viewer is a read position into it.
+// Sending is a sendmsg with one or two iovecs pointing straight into the
+// ring, so no frame is ever re-encoded or copied per viewer.
+//
+//   pong_relay [--port N] [--max-viewers N] [--ring-kb N] [--flush-ms N]
+//              [--seconds N]
+//
+// A new viewer starts at the newest keyframe and gets everything since in
+// its first send. A viewer that falls a whole ring behind is dropped.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "broadcast.h"
+#include "profile.h"
+
+#define MAX_EVENTS 512
+#define PEER_IN_SIZE 16 // enough for the hello
+
+typedef enum {
+  Peer_Pending, // connected, no hello yet
+  Peer_Publisher,
+  Peer_Viewer,
+} Peer_Kind;
+
+typedef struct Peer {
+  int fd; // -1 while on the free list
+  Peer_Kind kind;
+  uint8_t in[PEER_IN_SIZE];
+  int in_len;
+  uint64_t pos;  // ring offset of the next byte to send, viewers only
+  int slot;      // in Relay.viewers
+  bool want_out; // registered for EPOLLOUT
+  struct Peer *next_free;
+} Peer;
+
+typedef struct {
+  int port;
+  int max_viewers;
+  int ring_kb;  // rounded up to a power of two
+  int flush_ms; // 0 sends as frames arrive, otherwise coalesces
+  int seconds;  // 0 runs until SIGINT
+} Relay_Config;
+
+typedef struct {
+  uint64_t frames;
+  uint64_t bytes_in;
+  uint64_t sends;
+  uint64_t bytes_out;
+  uint64_t fanout_ns;
+  uint64_t lagged; // viewers dropped a whole ring behind
+} Relay_Stats;
+
+typedef struct {
+  const Relay_Config *config;
+  int epoll_fd;
+  int listen_fd;
+  int timer_fd;
+  Peer *peers;
+  Peer *free_peers;
+  int peer_cap;
+  Peer **viewers;
+  int viewer_cnt;
+  Peer *publisher;
+  // Frames from the publisher in arrival order. Offsets grow forever and
+  // are masked into the ring; [head - size, head) is what it still holds.
+  uint8_t *ring;
+  uint64_t ring_size;
+  uint64_t head;
+  uint64_t keyframe_at;
+  bool has_keyframe;
+  uint8_t source_in[BROADCAST_IN_SIZE];
+  int source_in_len;
+  Relay_Stats stats;
+} Relay;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+// Peers -----------------------------------------------------------------------
+
+static void set_want_out(Relay *r, Peer *p, bool want_out) {
+  if (want_out == p->want_out)
+    return;
+  struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = p};
+  if (want_out)
+    ev.events |= EPOLLOUT;
+  epoll_ctl(r->epoll_fd, EPOLL_CTL_MOD, p->fd, &ev);
+  p->want_out = want_out;
+}
+
+static void close_peer(Relay *r, Peer *p) {
+  if (p->kind == Peer_Viewer) {
+    Peer *last = r->viewers[--r->viewer_cnt];
+    r->viewers[p->slot] = last;
+    last->slot = p->slot;
+  } else if (p->kind == Peer_Publisher) {
+    r->publisher = NULL;
+  }
+  epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, p->fd, NULL);
+  close(p->fd);
+  p->fd = -1;
+  p->next_free = r->free_peers;
+  r->free_peers = p;
+}
+
+static void accept_peers(Relay *r) {
+  for (;;) {
+    int fd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0)
+      return;
+    Peer *p = r->free_peers;
+    if (!p) {
+      close(fd);
+      continue;
+    }
+    r->free_peers = p->next_free;
+    memset(p, 0, sizeof(*p));
+    p->fd = fd;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = p};
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+// Fan-out ---------------------------------------------------------------------
+
+// Sends whatever the viewer hasn't had yet straight from the ring. Returns
+// false once the viewer is closed.
+static bool flush_viewer(Relay *r, Peer *v) {
+  if (r->head - v->pos > r->ring_size) {
+    r->stats.lagged++;
+    close_peer(r, v);
+    return false;
+  }
+  while (v->pos < r->head) {
+    uint64_t mask = r->ring_size - 1;
+    uint64_t len = r->head - v->pos;
+    uint64_t first = r->ring_size - (v->pos & mask);
+    struct iovec iov[2] = {{r->ring + (v->pos & mask), len}};
+    int iov_cnt = 1;
+    if (len > first) {
+      iov[0].iov_len = first;
+      iov[1] = (struct iovec){r->ring, len - first};
+      iov_cnt = 2;
+    }
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iov_cnt};
+    ssize_t n = sendmsg(v->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    r->stats.sends++;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN) {
+        close_peer(r, v);
+        return false;
+      }
+      break;
+    }
+    v->pos += n;
+    r->stats.bytes_out += n;
+  }
+  set_want_out(r, v, v->pos < r->head);
+  return true;
+}
+
+static void flush_viewers(Relay *r) {
+  uint64_t start = profile_now_ns();
+  // Closing a viewer moves the last one into its slot, so walk backwards.
+  for (int i = r->viewer_cnt - 1; i >= 0; i--) {
+    Peer *v = r->viewers[i];
+    // A backlogged viewer is already waiting on EPOLLOUT.
+    if (!v->want_out || r->head - v->pos > r->ring_size)
+      flush_viewer(r, v);
+  }
+  r->stats.fanout_ns += profile_now_ns() - start;
+}
+
+static void append_frame(Relay *r, const uint8_t *frame, int len) {
+  if (frame[2] == Broadcast_Msg_Snapshot &&
+      len > BROADCAST_FRAME_HEADER + BROADCAST_SNAPSHOT_HEADER &&
+      frame[BROADCAST_FRAME_HEADER + 12]) {
+    r->keyframe_at = r->head;
+    r->has_keyframe = true;
+  }
+  uint64_t at = r->head & (r->ring_size - 1);
+  uint64_t first = r->ring_size - at;
+  if ((uint64_t)len <= first) {
+    memcpy(r->ring + at, frame, len);
+  } else {
+    memcpy(r->ring + at, frame, first);
+    memcpy(r->ring, frame + first, len - first);
+  }
+  r->head += len;
+  r->stats.frames++;
+}
+
+// Returns false once the publisher is closed.
+static bool read_publisher(Relay *r, Peer *p) {
+  bool appended = false;
+  for (;;) {
+    ssize_t n = recv(p->fd, r->source_in + r->source_in_len,
+                     BROADCAST_IN_SIZE - r->source_in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      close_peer(r, p);
+      break;
+    }
+    if (n < 0)
+      break;
+    r->source_in_len += n;
+    r->stats.bytes_in += n;
+
+    int at = 0;
+    while (r->source_in_len - at >= BROADCAST_FRAME_HEADER) {
+      int size = r->source_in[at] | r->source_in[at + 1] << 8;
+      if (size < 1 || size > BROADCAST_MAX_FRAME - 2) {
+        close_peer(r, p);
+        return false;
+      }
+      if (r->source_in_len - at < 2 + size)
+        break;
+      if (r->source_in[at + 2] == Broadcast_Msg_Snapshot) {
+        append_frame(r, r->source_in + at, 2 + size);
+        appended = true;
+      }
+      at += 2 + size;
+    }
+    memmove(r->source_in, r->source_in + at, r->source_in_len - at);
+    r->source_in_len -= at;
+  }
+  if (appended && r->config->flush_ms == 0)
+    flush_viewers(r);
+  return p->fd >= 0;
+}
+
+static void handle_hello(Relay *r, Peer *p, uint8_t type, const uint8_t *data,
+                         int len) {
+  if (len < 1 || data[0] != BROADCAST_VERSION) {
+    close_peer(r, p);
+    return;
+  }
+  if (type == Broadcast_Msg_Publish && !r->publisher) {
+    // A new stream; viewers that join now wait for its first keyframe.
+    p->kind = Peer_Publisher;
+    r->publisher = p;
+    r->source_in_len = 0;
+    r->has_keyframe = false;
+    fprintf(stderr, "pong_relay: publisher connected\n");
+  } else if (type == Broadcast_Msg_Watch) {
+    p->kind = Peer_Viewer;
+    p->pos = r->has_keyframe ? r->keyframe_at : r->head;
+    p->slot = r->viewer_cnt;
+    r->viewers[r->viewer_cnt++] = p;
+    flush_viewer(r, p);
+  } else {
+    close_peer(r, p);
+  }
+}
+
+// Returns false once the peer is closed.
+static bool read_peer(Relay *r, Peer *p) {
+  if (p->kind == Peer_Publisher)
+    return read_publisher(r, p);
+  for (;;) {
+    char discard[64];
+    uint8_t *buf = p->kind == Peer_Pending ? p->in + p->in_len
+                                           : (uint8_t *)discard;
+    int cap = p->kind == Peer_Pending ? PEER_IN_SIZE - p->in_len
+                                      : (int)sizeof(discard);
+    ssize_t n = recv(p->fd, buf, cap, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      close_peer(r, p);
+      return false;
+    }
+    if (n < 0)
+      return true;
+    if (p->kind != Peer_Pending)
+      continue; // viewers have nothing more to say
+    p->in_len += n;
+    if (p->in_len < BROADCAST_FRAME_HEADER)
+      continue;
+    int size = p->in[0] | p->in[1] << 8;
+    if (size < 1 || size > PEER_IN_SIZE - 2) {
+      close_peer(r, p);
+      return false;
+    }
+    if (p->in_len < 2 + size)
+      continue;
+    handle_hello(r, p, p->in[2], p->in + BROADCAST_FRAME_HEADER, size - 1);
+    if (p->fd < 0)
+      return false;
+    if (p->kind == Peer_Publisher) {
+      // Whatever followed the hello is the start of the stream.
+      int rest = p->in_len - 2 - size;
+      memcpy(r->source_in, p->in + 2 + size, rest);
+      r->source_in_len = rest;
+      return read_publisher(r, p);
+    }
+  }
+}
+
+// Main ------------------------------------------------------------------------
+
+static bool open_relay(Relay *r, const Relay_Config *config) {
+  memset(r, 0, sizeof(*r));
+  r->config = config;
+  r->epoll_fd = r->listen_fd = r->timer_fd = -1;
+  r->ring_size = 4096;
+  while (r->ring_size < (uint64_t)config->ring_kb * 1024)
+    r->ring_size *= 2;
+  r->ring = malloc(r->ring_size);
+  r->peer_cap = config->max_viewers + 1;
+  r->peers = calloc(r->peer_cap, sizeof(Peer));
+  r->viewers = calloc(r->peer_cap, sizeof(Peer *));
+  if (!r->ring || !r->peers || !r->viewers)
+    return false;
+  for (int i = r->peer_cap - 1; i >= 0; i--) {
+    r->peers[i].fd = -1;
+    r->peers[i].next_free = r->free_peers;
+    r->free_peers = &r->peers[i];
+  }
+
+  r->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(r->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(config->port);
+  if (bind(r->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(r->listen_fd, SOMAXCONN) != 0) {
+    perror("pong_relay: listen");
+    return false;
+  }
+
+  r->epoll_fd = epoll_create1(0);
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &r->listen_fd};
+  epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->listen_fd, &ev);
+  if (config->flush_ms > 0) {
+    r->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    long ns = config->flush_ms * 1000000l;
+    struct itimerspec period = {{ns / 1000000000, ns % 1000000000},
+                                {ns / 1000000000, ns % 1000000000}};
+    timerfd_settime(r->timer_fd, 0, &period, NULL);
+    ev.data.ptr = &r->timer_fd;
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->timer_fd, &ev);
+  }
+  return r->epoll_fd >= 0;
+}
+
+static void close_relay(Relay *r) {
+  for (int i = 0; i < r->peer_cap && r->peers; i++)
+    if (r->peers[i].fd >= 0)
+      close(r->peers[i].fd);
+  if (r->epoll_fd >= 0)
+    close(r->epoll_fd);
+  if (r->listen_fd >= 0)
+    close(r->listen_fd);
+  if (r->timer_fd >= 0)
+    close(r->timer_fd);
+  free(r->ring);
+  free(r->peers);
+  free(r->viewers);
+}
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--port N] [--max-viewers N] [--ring-kb N]\n"
+          "          [--flush-ms N] [--seconds N]\n",
+          prog);
+}
+
+static bool parse_options(Relay_Config *c, int argc, char **argv) {
+  c->port = BROADCAST_DEFAULT_PORT;
+  c->max_viewers = 16384;
+  c->ring_kb = 4096; // about half an hour of one match
+  c->flush_ms = 0;
+  c->seconds = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!value) {
+      return false;
+    } else if (strcmp(arg, "--port") == 0) {
+      c->port = atoi(value);
+    } else if (strcmp(arg, "--max-viewers") == 0) {
+      c->max_viewers = atoi(value);
+    } else if (strcmp(arg, "--ring-kb") == 0) {
+      c->ring_kb = atoi(value);
+    } else if (strcmp(arg, "--flush-ms") == 0) {
+      c->flush_ms = atoi(value);
+    } else if (strcmp(arg, "--seconds") == 0) {
+      c->seconds = atoi(value);
+    } else {
+      return false;
+    }
+    i++;
+  }
+  return c->max_viewers > 0 && c->ring_kb > 0 && c->flush_ms >= 0;
+}
+
+int main(int argc, char **argv) {
+  Relay_Config config;
+  if (!parse_options(&config, argc, argv)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  struct rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  static Relay relay;
+  Relay *r = &relay;
+  bool ok = open_relay(r, &config);
+  if (ok)
+    fprintf(stderr, "pong_relay: port %d, up to %d viewers, %llu KB ring\n",
+            config.port, config.max_viewers,
+            (unsigned long long)r->ring_size / 1024);
+
+  uint64_t start = profile_now_ns();
+  uint64_t next_report = start + 1000000000ull;
+  Relay_Stats last = {0};
+  struct epoll_event events[MAX_EVENTS];
+  while (ok && !stop) {
+    uint64_t now = profile_now_ns();
+    if (config.seconds > 0 &&
+        now - start >= (uint64_t)config.seconds * 1000000000ull)
+      break;
+
+    int n = epoll_wait(r->epoll_fd, events, MAX_EVENTS, 100);
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == &r->listen_fd) {
+        accept_peers(r);
+      } else if (ptr == &r->timer_fd) {
+        uint64_t expirations;
+        if (read(r->timer_fd, &expirations, sizeof(expirations)) > 0)
+          flush_viewers(r);
+      } else {
+        Peer *p = ptr;
+        if (p->fd < 0)
+          continue; // closed earlier in this batch
+        if ((events[i].events & EPOLLIN) && !read_peer(r, p))
+          continue;
+        if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+          close_peer(r, p);
+        else if ((events[i].events & EPOLLOUT) && p->kind == Peer_Viewer)
+          flush_viewer(r, p);
+      }
+    }
+
+    // Once a second: viewers, what came in and what the fan-out cost.
+    now = profile_now_ns();
+    if (now >= next_report) {
+      Relay_Stats *s = &r->stats;
+      uint64_t frames = s->frames - last.frames;
+      printf("viewers %d, %s, %llu frames/s of %.1f bytes, %llu sends/s, "
+             "%.2f MB/s out, %.1fus fan-out per frame, %llu lagged\n",
+             r->viewer_cnt, r->publisher ? "live" : "no publisher",
+             (unsigned long long)frames,
+             frames ? (double)(s->bytes_in - last.bytes_in) / frames : 0.0,
+             (unsigned long long)(s->sends - last.sends),
+             (s->bytes_out - last.bytes_out) / 1e6,
+             frames ? (s->fanout_ns - last.fanout_ns) / 1e3 / frames : 0.0,
+             (unsigned long long)s->lagged);
+      fflush(stdout);
+      last = *s;
+      next_report += 1000000000ull;
+    }
+  }
+
+  close_relay(r);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+#include "replay.h"
+
+#include <string.h>
+
+typedef enum {
+  Replay_Tag_Begin = 'B',
+  Replay_Tag_Inputs = 'I',
+  Replay_Tag_Aspect = 'A',
+  Replay_Tag_Keyframe = 'K',
+  Replay_Tag_End = 'E',
+} Replay_Tag;
+
+static void write_u32(FILE *f, uint32_t v) {
+  uint8_t b[4];
+  for (int i = 0; i < 4; i++)
+    b[i] = v >> (8 * i);
+  fwrite(b, 1, sizeof(b), f);
+}
+
+static void write_u64(FILE *f, uint64_t v) {
+  uint8_t b[8];
+  for (int i = 0; i < 8; i++)
+    b[i] = v >> (8 * i);
+  fwrite(b, 1, sizeof(b), f);
+}
+
+static void write_varint(FILE *f, uint64_t v) {
+  while (v >= 0x80) {
+    fputc((v & 0x7f) | 0x80, f);
+    v >>= 7;
+  }
+  fputc(v, f);
+}
+
+static void write_state(FILE *f, const State *s) {
+  uint8_t blob[STATE_BLOB_SIZE];
+  pack_state(s, blob);
+  fwrite(blob, 1, sizeof(blob), f);
+}
+
+static bool read_u32(FILE *f, uint32_t *v) {
+  uint8_t b[4];
+  if (fread(b, 1, sizeof(b), f) != sizeof(b))
+    return false;
+  *v = 0;
+  for (int i = 0; i < 4; i++)
+    *v |= (uint32_t)b[i] << (8 * i);
+  return true;
+}
+
+static bool read_u64(FILE *f, uint64_t *v) {
+  uint8_t b[8];
+  if (fread(b, 1, sizeof(b), f) != sizeof(b))
+    return false;
+  *v = 0;
+  for (int i = 0; i < 8; i++)
+    *v |= (uint64_t)b[i] << (8 * i);
+  return true;
+}
+
+static bool read_varint(FILE *f, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(f);
+    if (c == EOF)
+      return false;
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static bool read_blob(FILE *f, uint8_t blob[STATE_BLOB_SIZE]) {
+  return fread(blob, 1, STATE_BLOB_SIZE, f) == STATE_BLOB_SIZE;
+}
+
+static void flush_run(Replay_Writer *w) {
+  if (w->run_length == 0)
+    return;
+  fputc(Replay_Tag_Inputs, w->file);
+  write_varint(w->file, w->run_input);
+  write_varint(w->file, w->run_length);
+  w->run_length = 0;
+}
+
+bool replay_writer_open(Replay_Writer *w, const char *path, uint64_t seed) {
+  w->file = fopen(path, "wb");
+  if (!w->file)
+    return false;
+
+  w->header.version = REPLAY_VERSION;
+  w->header.tick_rate = TICK_RATE;
+  w->header.keyframe_interval = REPLAY_KEYFRAME_INTERVAL;
+  w->header.seed = seed;
+  w->in_match = false;
+  w->tick = 0;
+  w->run_length = 0;
+
+  fwrite(REPLAY_MAGIC, 1, sizeof(REPLAY_MAGIC), w->file);
+  write_u32(w->file, w->header.version);
+  write_u32(w->file, w->header.tick_rate);
+  write_u32(w->file, w->header.keyframe_interval);
+  write_u64(w->file, w->header.seed);
+  return true;
+}
+
+void replay_begin_match(Replay_Writer *w, const State *s) {
+  if (w->in_match)
+    replay_end_match(w);
+
+  fputc(Replay_Tag_Begin, w->file);
+  write_state(w->file, s);
+  w->in_match = true;
+  w->tick = 0;
+  w->aspect_ratio = s->aspect_ratio;
+}
+
+void replay_record_tick(Replay_Writer *w, const State *s, Input input) {
+  if (!w->in_match)
+    return;
+
+  // The aspect goes first even on keyframe ticks: the reader checks the
+  // keyframe against its own state, which needs the new aspect already.
+  if (s->aspect_ratio != w->aspect_ratio) {
+    flush_run(w);
+    uint32_t bits;
+    memcpy(&bits, &s->aspect_ratio, sizeof(bits));
+    fputc(Replay_Tag_Aspect, w->file);
+    write_u32(w->file, bits);
+    w->aspect_ratio = s->aspect_ratio;
+  }
+  if (w->tick != 0 && w->tick % w->header.keyframe_interval == 0) {
+    flush_run(w);
+    fputc(Replay_Tag_Keyframe, w->file);
+    write_u64(w->file, w->tick);
+    write_state(w->file, s);
+  }
+
+  if (w->run_length > 0 && w->run_input != input)
+    flush_run(w);
+  w->run_input = input;
+  w->run_length++;
+  w->tick++;
+}
+
+void replay_end_match(Replay_Writer *w) {
+  if (!w->in_match)
+    return;
+  flush_run(w);
+  fputc(Replay_Tag_End, w->file);
+  w->in_match = false;
+}
+
+void replay_writer_close(Replay_Writer *w) {
+  replay_end_match(w);
+  fclose(w->file);
+  w->file = NULL;
+}
+
+bool replay_reader_open(Replay_Reader *r, const char *path) {
+  r->file = fopen(path, "rb");
+  if (!r->file)
+    return false;
+
+  char magic[sizeof(REPLAY_MAGIC)];
+  if (fread(magic, 1, sizeof(magic), r->file) != sizeof(magic) ||
+      memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+      !read_u32(r->file, &r->header.version) ||
+      !read_u32(r->file, &r->header.tick_rate) ||
+      !read_u32(r->file, &r->header.keyframe_interval) ||
+      !read_u64(r->file, &r->header.seed) ||
+      r->header.version != REPLAY_VERSION ||
+      r->header.tick_rate != TICK_RATE) {
+    fclose(r->file);
+    r->file = NULL;
+    return false;
+  }
+
+  r->in_match = false;
+  r->tick = 0;
+  r->run_left = 0;
+  r->desyncs = 0;
+  r->match_cnt = 0;
+  return true;
+}
+
+bool replay_next_tick(Replay_Reader *r, State *s, Input *input) {
+  uint8_t blob[STATE_BLOB_SIZE];
+  uint8_t current[STATE_BLOB_SIZE];
+  uint64_t a, b;
+  uint32_t bits;
+  State key;
+
+  for (;;) {
+    if (r->in_match && r->run_left > 0) {
+      *input = r->run_input;
+      r->run_left--;
+      r->tick++;
+      return true;
+    }
+
+    int tag = fgetc(r->file);
+    switch (tag) {
+    case Replay_Tag_Begin:
+      if (!read_blob(r->file, blob))
+        return false;
+      unpack_state(blob, s);
+      r->in_match = true;
+      r->tick = 0;
+      r->match_cnt++;
+      break;
+    case Replay_Tag_Inputs:
+      if (!read_varint(r->file, &a) || !read_varint(r->file, &b))
+        return false;
+      r->run_input = a;
+      r->run_left = b;
+      break;
+    case Replay_Tag_Aspect:
+      if (!read_u32(r->file, &bits))
+        return false;
+      memcpy(&s->aspect_ratio, &bits, sizeof(bits));
+      break;
+    case Replay_Tag_Keyframe:
+      if (!read_u64(r->file, &a) || !read_blob(r->file, blob))
+        return false;
+      // A mismatch means the simulation changed since recording; resync so
+      // the rest of the replay still plays. Menu selections are moved by
+      // handle_input, not by inputs, so they aren't part of the check.
+      key = *s;
+      unpack_state(blob, &key);
+      key.main_menu.selected_item = s->main_menu.selected_item;
+      key.win_screen.selected_item = s->win_screen.selected_item;
+      pack_state(&key, blob);
+      pack_state(s, current);
+      if (a != r->tick || memcmp(blob, current, sizeof(blob)) != 0) {
+        r->desyncs++;
+        unpack_state(blob, s);
+        r->tick = a;
+      }
+      break;
+    case Replay_Tag_End:
+      r->in_match = false;
+      s->step = Step_Main_Menu;
+      break;
+    default:
+      return false;
+    }
+  }
+}
+
+void replay_reader_close(Replay_Reader *r) {
+  fclose(r->file);
+  r->file = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef PONG_REPLAY_H
+#define PONG_REPLAY_H
+
+// Replays store inputs, not frames. A file is a header followed by tagged
+// records:
+//
+//   'B' state          a match begins from this State
+//   'I' input run      varint Input, varint tick count
+//   'A' f32            aspect ratio changed before the next tick
+//   'K' u64 tick state periodic keyframe, checked on playback
+//   'E'                the match ended (back to the main menu)
+//
+// All integers are little-endian, states are pack_state blobs. Since the
+// RNG lives in State, the inputs alone reproduce a match exactly; the
+// keyframes catch desyncs and give later tools a place to seek to.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sim.h"
+
+#define REPLAY_MAGIC "PONGRPL"
+#define REPLAY_VERSION 1
+#define REPLAY_KEYFRAME_INTERVAL (TICK_RATE * 10)
+
+typedef struct {
+  uint32_t version;
+  uint32_t tick_rate;
+  uint32_t keyframe_interval;
+  uint64_t seed;
+} Replay_Header;
+
+typedef struct {
+  FILE *file;
+  Replay_Header header;
+  bool in_match;
+  uint64_t tick;
+  Input run_input;
+  uint32_t run_length;
+  float aspect_ratio;
+} Replay_Writer;
+
+typedef struct {
+  FILE *file;
+  Replay_Header header;
+  bool in_match;
+  uint64_t tick;
+  Input run_input;
+  uint32_t run_left;
+  uint64_t desyncs;
+  uint32_t match_cnt; // 'B' records seen so far
+} Replay_Reader;
+
+bool replay_writer_open(Replay_Writer *w, const char *path, uint64_t seed);
+void replay_begin_match(Replay_Writer *w, const State *s);
+// Call right before update_state with the state about to be stepped.
+void replay_record_tick(Replay_Writer *w, const State *s, Input input);
+void replay_end_match(Replay_Writer *w);
+void replay_writer_close(Replay_Writer *w);
+
+bool replay_reader_open(Replay_Reader *r, const char *path);
+// Applies match starts, aspect changes and keyframes to s until the next
+// tick, then stores its input. Returns false at the end of the replay or on
+// a malformed file.
+bool replay_next_tick(Replay_Reader *r, State *s, Input *input);
+void replay_reader_close(Replay_Reader *r);
+
+#endif
@@ -0,0 +1,670 @@
+// Authoritative headless game server. Hosts many matches per process: one
+// shard per worker thread, each pinned to a core with its own SO_REUSEPORT
+// listener, epoll set and tick timer, so a match and its clients never leave
+// the thread that accepted them and shards share nothing.
+//
+//   pong_server [--port N] [--workers N] [--max-matches N] [--send-every T]
+//               [--points N] [--seconds N] [--no-pin]
+//
+// Clients speak server_proto.h; loadgen.c is a client that opens thousands
+// of them to measure how many matches a box can hold.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "bytes.h"
+#include "profile.h"
+#include "server_proto.h"
+#include "sim.h"
+#include "snapshot.h"
+
+#define MAX_WORKERS 256
+#define MAX_EVENTS 512
+#define MAX_CATCHUP_TICKS 8 // ticks run per timer wakeup after a stall
+#define CONN_IN_SIZE 64
+#define CONN_OUT_SIZE 256
+
+typedef struct Match Match;
+
+typedef struct Conn {
+  int fd; // -1 while on the free list
+  Match *match;
+  Side side;
+  uint8_t keys; // Server_Key
+  uint32_t stamp;
+  uint32_t acked; // newest snapshot sequence the client has, plus one
+  uint8_t in[CONN_IN_SIZE];
+  int in_len;
+  uint8_t out[CONN_OUT_SIZE];
+  int out_len;
+  bool want_out; // registered for EPOLLOUT
+  struct Conn *next_free;
+} Conn;
+
+struct Match {
+  State state;
+  Conn *players[2]; // by Side, NULL where the server AI plays
+  Ai_Controller ai[2];
+  uint32_t id;
+  int slot; // in Shard.active, -1 while waiting for an opponent
+  Snapshot history[SERVER_SNAPSHOT_HISTORY]; // baselines, by sequence
+  uint32_t snapshot_seq;                     // sequence of the next one
+  Match *next_free;
+};
+
+typedef struct {
+  int port;
+  int worker_cnt;      // 0 picks one per online core
+  int max_matches;     // per process
+  int send_every;      // ticks between state messages
+  int points_to_win;   // scores reset after this
+  int seconds;         // 0 runs until SIGINT
+  bool pin;
+} Server_Config;
+
+typedef struct {
+  _Alignas(64) atomic_uint_least64_t ticks;
+  atomic_uint_least64_t sim_ns;
+  atomic_uint_least64_t send_ns;
+  atomic_uint_least64_t states_sent;
+  atomic_uint_least64_t states_dropped;
+  atomic_uint_least64_t state_bytes;
+  atomic_int matches;
+  atomic_int conns;
+} Shard_Stats;
+
+typedef struct {
+  const Server_Config *config;
+  int index;
+  int epoll_fd;
+  int listen_fd;
+  int timer_fd;
+  Conn *conns;
+  Conn *free_conns;
+  int conn_cap;
+  Match *matches;
+  Match *free_matches;
+  Match **active;
+  int active_cnt;
+  Match *waiting; // a versus match with one player
+  uint32_t next_match_id;
+  uint64_t tick;
+  Shard_Stats stats;
+} Shard;
+
+static atomic_bool stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  atomic_store(&stop, true);
+}
+
+// Connections -----------------------------------------------------------------
+
+static void flush_conn(Shard *sh, Conn *c) {
+  int sent = 0;
+  while (sent < c->out_len) {
+    ssize_t n = send(c->fd, c->out + sent, c->out_len - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+  memmove(c->out, c->out + sent, c->out_len - sent);
+  c->out_len -= sent;
+
+  bool want_out = c->out_len > 0;
+  if (want_out == c->want_out)
+    return;
+  struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+  if (want_out)
+    ev.events |= EPOLLOUT;
+  epoll_ctl(sh->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+  c->want_out = want_out;
+}
+
+// Queues one framed message. State is sent again every few ticks, so a
+// client that can't keep up loses snapshots instead of buffering them.
+static bool send_msg(Shard *sh, Conn *c, Server_Msg type, const uint8_t *data,
+                     int len) {
+  bool backlogged = c->out_len > 0;
+  if (c->out_len + SERVER_FRAME_HEADER + len > CONN_OUT_SIZE)
+    return false;
+  uint8_t *p = c->out + c->out_len;
+  p[0] = (len + 1) & 0xff;
+  p[1] = (len + 1) >> 8;
+  p[2] = type;
+  memcpy(p + SERVER_FRAME_HEADER, data, len);
+  c->out_len += SERVER_FRAME_HEADER + len;
+  // A backlogged connection is already waiting on EPOLLOUT.
+  if (!backlogged)
+    flush_conn(sh, c);
+  return true;
+}
+
+// Matches ---------------------------------------------------------------------
+
+static void start_match(Shard *sh, Match *m) {
+  init_state(&m->state, (uint64_t)sh->index << 32 | m->id);
+  m->state.step = Step_Running;
+  m->state.pause = false;
+  Ai_Config ai_config;
+  init_ai_config(&ai_config);
+  for (int side = 0; side < 2; side++)
+    ai_init(&m->ai[side], side, &ai_config);
+  m->slot = sh->active_cnt;
+  sh->active[sh->active_cnt++] = m;
+  atomic_fetch_add(&sh->stats.matches, 1);
+}
+
+static Match *alloc_match(Shard *sh) {
+  Match *m = sh->free_matches;
+  if (!m)
+    return NULL;
+  sh->free_matches = m->next_free;
+  memset(m, 0, sizeof(*m));
+  m->id = sh->next_match_id++;
+  m->slot = -1;
+  return m;
+}
+
+static void free_match(Shard *sh, Match *m) {
+  if (m->slot >= 0) {
+    Match *last = sh->active[--sh->active_cnt];
+    sh->active[m->slot] = last;
+    last->slot = m->slot;
+    atomic_fetch_sub(&sh->stats.matches, 1);
+  }
+  if (sh->waiting == m)
+    sh->waiting = NULL;
+  m->next_free = sh->free_matches;
+  sh->free_matches = m;
+}
+
+// Returns false when the shard has no match left for the client.
+static bool join(Shard *sh, Conn *c, Server_Join_Mode mode) {
+  Match *m;
+  Side side = Side_Left;
+  if (mode == Server_Join_Versus && sh->waiting) {
+    m = sh->waiting;
+    sh->waiting = NULL;
+    side = Side_Right;
+  } else if (!(m = alloc_match(sh))) {
+    return false;
+  }
+  m->players[side] = c;
+  c->match = m;
+  c->side = side;
+  if (mode == Server_Join_Versus && side == Side_Left)
+    sh->waiting = m;
+  else
+    start_match(sh, m);
+
+  uint8_t welcome[SERVER_WELCOME_SIZE];
+  welcome[0] = side;
+  put_u32(welcome + 1, m->id);
+  send_msg(sh, c, Server_Msg_Welcome, welcome, sizeof(welcome));
+  return true;
+}
+
+static void close_conn(Shard *sh, Conn *c) {
+  Match *m = c->match;
+  if (m) {
+    // The server AI takes over the paddle of a player that left.
+    m->players[c->side] = NULL;
+    if (!m->players[Side_Left] && !m->players[Side_Right])
+      free_match(sh, m);
+  }
+  epoll_ctl(sh->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
+  c->next_free = sh->free_conns;
+  sh->free_conns = c;
+  atomic_fetch_sub(&sh->stats.conns, 1);
+}
+
+static void accept_conns(Shard *sh) {
+  for (;;) {
+    int fd = accept4(sh->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0)
+      return;
+    Conn *c = sh->free_conns;
+    if (!c) {
+      close(fd);
+      continue;
+    }
+    sh->free_conns = c->next_free;
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+    epoll_ctl(sh->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    atomic_fetch_add(&sh->stats.conns, 1);
+  }
+}
+
+// Returns false if the connection has to be closed.
+static bool handle_msg(Shard *sh, Conn *c, uint8_t type, const uint8_t *p,
+                       int len) {
+  switch ((Server_Msg)type) {
+  case Server_Msg_Join:
+    if (len >= SERVER_JOIN_SIZE && p[0] == SERVER_PROTO_VERSION && !c->match)
+      return join(sh, c, p[1] == Server_Join_Versus ? Server_Join_Versus
+                                                    : Server_Join_Ai);
+    break;
+  case Server_Msg_Input:
+    if (len >= SERVER_INPUT_SIZE) {
+      c->keys = p[0] & (Server_Key_Up | Server_Key_Down);
+      get_u32(p + 1, &c->stamp);
+      get_u32(p + 5, &c->acked);
+    }
+    break;
+  case Server_Msg_Welcome:
+  case Server_Msg_State:
+    break;
+  }
+  return true;
+}
+
+// Returns false once the connection is closed.
+static bool read_conn(Shard *sh, Conn *c) {
+  for (;;) {
+    ssize_t n = recv(c->fd, c->in + c->in_len, CONN_IN_SIZE - c->in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      close_conn(sh, c);
+      return false;
+    }
+    if (n < 0)
+      return true;
+    c->in_len += n;
+
+    int at = 0;
+    while (c->in_len - at >= SERVER_FRAME_HEADER) {
+      int size = c->in[at] | c->in[at + 1] << 8;
+      if (size < 1 || size > CONN_IN_SIZE - 2) {
+        close_conn(sh, c);
+        return false;
+      }
+      if (c->in_len - at < 2 + size)
+        break;
+      if (!handle_msg(sh, c, c->in[at + 2], c->in + at + SERVER_FRAME_HEADER,
+                      size - 1)) {
+        close_conn(sh, c);
+        return false;
+      }
+      at += 2 + size;
+    }
+    memmove(c->in, c->in + at, c->in_len - at);
+    c->in_len -= at;
+  }
+}
+
+// Simulation ------------------------------------------------------------------
+
+static Input player_input(const Conn *c) {
+  Input up = c->side == Side_Left ? Input_Left_Up : Input_Right_Up;
+  Input down = c->side == Side_Left ? Input_Left_Down : Input_Right_Down;
+  return (c->keys & Server_Key_Up ? up : 0) |
+         (c->keys & Server_Key_Down ? down : 0);
+}
+
+static void step_match(const Server_Config *config, Match *m) {
+  Input input = 0;
+  for (int side = 0; side < 2; side++)
+    input |= m->players[side] ? player_input(m->players[side])
+                              : ai_decide_state(&m->ai[side], &m->state);
+  update_state(&m->state, input, TICK_DELTA);
+
+  if (m->state.step == Step_Win_Screen) {
+    if (m->state.left_player_score >= config->points_to_win ||
+        m->state.right_player_score >= config->points_to_win) {
+      m->state.left_player_score = 0;
+      m->state.right_player_score = 0;
+    }
+    init_game_field(&m->state);
+    m->state.step = Step_Running;
+  }
+}
+
+// Each match sends on its own phase of send_every, so a tick sends for a
+// slice of the matches instead of all of them in one burst every few ticks.
+static void send_states(Shard *sh) {
+  uint8_t msg[SERVER_STATE_MAX_SIZE];
+  put_u32(msg, (uint32_t)sh->tick);
+  uint32_t phase = sh->tick % sh->config->send_every;
+  uint64_t sent = 0, dropped = 0, bytes = 0;
+  for (int i = 0; i < sh->active_cnt; i++) {
+    Match *m = sh->active[i];
+    if (m->id % sh->config->send_every != phase)
+      continue;
+    uint32_t seq = m->snapshot_seq++;
+    Snapshot *cur = &m->history[seq % SERVER_SNAPSHOT_HISTORY];
+    snapshot_quantize(&m->state, cur);
+    put_u32(msg + 8, seq);
+
+    for (int side = 0; side < 2; side++) {
+      Conn *c = m->players[side];
+      if (!c)
+        continue;
+      // Delta against what the client has, if we still have it too.
+      uint32_t back = seq - (c->acked - 1);
+      const Snapshot *base = NULL;
+      if (c->acked == 0 || c->acked > seq || back >= SERVER_SNAPSHOT_HISTORY)
+        back = 0;
+      else
+        base = &m->history[(c->acked - 1) % SERVER_SNAPSHOT_HISTORY];
+      put_u32(msg + 4, c->stamp);
+      msg[12] = back;
+      int len = SERVER_STATE_HEADER +
+                snapshot_encode(cur, base, msg + SERVER_STATE_HEADER);
+      if (send_msg(sh, c, Server_Msg_State, msg, len)) {
+        sent++;
+        bytes += SERVER_FRAME_HEADER + len;
+      } else {
+        dropped++;
+      }
+    }
+  }
+  atomic_fetch_add(&sh->stats.states_sent, sent);
+  atomic_fetch_add(&sh->stats.states_dropped, dropped);
+  atomic_fetch_add(&sh->stats.state_bytes, bytes);
+}
+
+static void run_ticks(Shard *sh) {
+  uint64_t expirations = 0;
+  if (read(sh->timer_fd, &expirations, sizeof(expirations)) < 0)
+    return;
+  if (expirations > MAX_CATCHUP_TICKS)
+    expirations = MAX_CATCHUP_TICKS;
+
+  uint64_t sim_ns = 0, send_ns = 0;
+  for (uint64_t t = 0; t < expirations; t++) {
+    uint64_t start = profile_now_ns();
+    for (int i = 0; i < sh->active_cnt; i++)
+      step_match(sh->config, sh->active[i]);
+    sh->tick++;
+    uint64_t stepped = profile_now_ns();
+    send_states(sh);
+    sim_ns += stepped - start;
+    send_ns += profile_now_ns() - stepped;
+  }
+  atomic_fetch_add(&sh->stats.sim_ns, sim_ns);
+  atomic_fetch_add(&sh->stats.send_ns, send_ns);
+  atomic_fetch_add(&sh->stats.ticks, expirations);
+}
+
+// Shards ----------------------------------------------------------------------
+
+static bool open_shard(Shard *sh, const Server_Config *config, int index,
+                       int match_cap) {
+  memset(sh, 0, sizeof(*sh));
+  sh->config = config;
+  sh->index = index;
+  sh->epoll_fd = sh->listen_fd = sh->timer_fd = -1;
+  sh->conn_cap = match_cap * 2;
+  sh->conns = calloc(sh->conn_cap, sizeof(Conn));
+  sh->matches = calloc(match_cap, sizeof(Match));
+  sh->active = calloc(match_cap, sizeof(Match *));
+  if (!sh->conns || !sh->matches || !sh->active)
+    return false;
+  for (int i = sh->conn_cap - 1; i >= 0; i--) {
+    sh->conns[i].fd = -1;
+    sh->conns[i].next_free = sh->free_conns;
+    sh->free_conns = &sh->conns[i];
+  }
+  for (int i = match_cap - 1; i >= 0; i--) {
+    sh->matches[i].next_free = sh->free_matches;
+    sh->free_matches = &sh->matches[i];
+  }
+
+  // Every shard listens on the same port; the kernel spreads connections.
+  sh->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(sh->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(sh->listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(config->port);
+  if (bind(sh->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sh->listen_fd, SOMAXCONN) != 0) {
+    perror("pong_server: listen");
+    return false;
+  }
+
+  sh->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  struct itimerspec period = {{0, 1000000000 / TICK_RATE},
+                              {0, 1000000000 / TICK_RATE}};
+  timerfd_settime(sh->timer_fd, 0, &period, NULL);
+
+  sh->epoll_fd = epoll_create1(0);
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &sh->listen_fd};
+  epoll_ctl(sh->epoll_fd, EPOLL_CTL_ADD, sh->listen_fd, &ev);
+  ev.data.ptr = &sh->timer_fd;
+  epoll_ctl(sh->epoll_fd, EPOLL_CTL_ADD, sh->timer_fd, &ev);
+  return sh->timer_fd >= 0 && sh->epoll_fd >= 0;
+}
+
+static void close_shard(Shard *sh) {
+  for (int i = 0; i < sh->conn_cap && sh->conns; i++)
+    if (sh->conns[i].fd >= 0)
+      close(sh->conns[i].fd);
+  if (sh->epoll_fd >= 0)
+    close(sh->epoll_fd);
+  if (sh->listen_fd >= 0)
+    close(sh->listen_fd);
+  if (sh->timer_fd >= 0)
+    close(sh->timer_fd);
+  free(sh->conns);
+  free(sh->matches);
+  free(sh->active);
+}
+
+// Pins the calling thread to the index-th CPU it may run on, so shards
+// spread over a restricted mask (taskset, cgroups) instead of piling up on
+// CPU numbers it doesn't contain.
+static void pin_shard(int index) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    perror("pong_server: sched_getaffinity");
+    return;
+  }
+  int nth = index % CPU_COUNT(&allowed);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed) || nth-- > 0)
+      continue;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+      perror("pong_server: sched_setaffinity");
+    return;
+  }
+}
+
+static int shard_main(void *arg) {
+  Shard *sh = arg;
+  if (sh->config->pin)
+    pin_shard(sh->index);
+
+  struct epoll_event events[MAX_EVENTS];
+  while (!atomic_load(&stop)) {
+    int n = epoll_wait(sh->epoll_fd, events, MAX_EVENTS, 100);
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == &sh->listen_fd) {
+        accept_conns(sh);
+      } else if (ptr == &sh->timer_fd) {
+        run_ticks(sh);
+      } else {
+        Conn *c = ptr;
+        if ((events[i].events & EPOLLIN) && !read_conn(sh, c))
+          continue;
+        if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+          close_conn(sh, c);
+        else if (events[i].events & EPOLLOUT)
+          flush_conn(sh, c);
+      }
+    }
+  }
+  return 0;
+}
+
+// Main ------------------------------------------------------------------------
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--port N] [--workers N] [--max-matches N]\n"
+          "          [--send-every TICKS] [--points N] [--seconds N] "
+          "[--no-pin]\n",
+          prog);
+}
+
+static bool parse_options(Server_Config *c, int argc, char **argv) {
+  c->port = SERVER_DEFAULT_PORT;
+  c->worker_cnt = 0;
+  c->max_matches = 16384;
+  c->send_every = 4; // 60 states per second
+  c->points_to_win = 11;
+  c->seconds = 0;
+  c->pin = true;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--no-pin") == 0) {
+      c->pin = false;
+      continue;
+    } else if (!value) {
+      return false;
+    } else if (strcmp(arg, "--port") == 0) {
+      c->port = atoi(value);
+    } else if (strcmp(arg, "--workers") == 0) {
+      c->worker_cnt = atoi(value);
+    } else if (strcmp(arg, "--max-matches") == 0) {
+      c->max_matches = atoi(value);
+    } else if (strcmp(arg, "--send-every") == 0) {
+      c->send_every = atoi(value);
+    } else if (strcmp(arg, "--points") == 0) {
+      c->points_to_win = atoi(value);
+    } else if (strcmp(arg, "--seconds") == 0) {
+      c->seconds = atoi(value);
+    } else {
+      return false;
+    }
+    i++;
+  }
+  return c->max_matches > 0 && c->send_every > 0;
+}
+
+int main(int argc, char **argv) {
+  Server_Config config;
+  if (!parse_options(&config, argc, argv)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  int worker_cnt = config.worker_cnt;
+  if (worker_cnt <= 0)
+    worker_cnt = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (worker_cnt <= 0)
+    worker_cnt = 1;
+  if (worker_cnt > MAX_WORKERS)
+    worker_cnt = MAX_WORKERS;
+
+  // Two sockets per versus match, plus some slack.
+  struct rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  Shard *shards = aligned_alloc(64, sizeof(Shard) * worker_cnt);
+  thrd_t *threads = calloc(worker_cnt, sizeof(thrd_t));
+  if (!shards || !threads)
+    return 1;
+  int match_cap = (config.max_matches + worker_cnt - 1) / worker_cnt;
+  int opened = 0;
+  bool ok = true;
+  for (; opened < worker_cnt && ok; opened++)
+    ok = open_shard(&shards[opened], &config, opened, match_cap);
+  int started = 0;
+  for (; ok && started < worker_cnt; started++)
+    if (thrd_create(&threads[started], shard_main, &shards[started]) !=
+        thrd_success)
+      break;
+  if (ok)
+    fprintf(stderr, "pong_server: port %d, %d workers, %d matches each\n",
+            config.port, started, match_cap);
+
+  // Once a second: matches, connections, tick rate and how busy the workers
+  // are simulating and sending.
+  uint64_t last_ticks = 0, last_sim_ns = 0, last_send_ns = 0;
+  uint64_t last_sent = 0, last_dropped = 0, last_bytes = 0;
+  uint64_t last_ns = profile_now_ns();
+  for (int second = 0; ok && !atomic_load(&stop); second++) {
+    if (config.seconds > 0 && second >= config.seconds)
+      break;
+    thrd_sleep(&(struct timespec){1, 0}, NULL);
+    uint64_t ticks = 0, sim_ns = 0, send_ns = 0, sent = 0, dropped = 0;
+    uint64_t bytes = 0;
+    int matches = 0, conns = 0;
+    for (int i = 0; i < started; i++) {
+      Shard_Stats *st = &shards[i].stats;
+      ticks += atomic_load(&st->ticks);
+      sim_ns += atomic_load(&st->sim_ns);
+      send_ns += atomic_load(&st->send_ns);
+      sent += atomic_load(&st->states_sent);
+      dropped += atomic_load(&st->states_dropped);
+      bytes += atomic_load(&st->state_bytes);
+      matches += atomic_load(&st->matches);
+      conns += atomic_load(&st->conns);
+    }
+    uint64_t now = profile_now_ns();
+    double elapsed = (now - last_ns) / 1e9;
+    double busy = elapsed * started / 100;
+    printf("matches %d, clients %d, %.0f ticks/s per worker, sim %.1f%%, "
+           "send %.1f%%, %.0f states/s of %.1f bytes, %.0f dropped/s\n",
+           matches, conns, (ticks - last_ticks) / elapsed / started,
+           (sim_ns - last_sim_ns) / 1e9 / busy,
+           (send_ns - last_send_ns) / 1e9 / busy, (sent - last_sent) / elapsed,
+           sent > last_sent ? (double)(bytes - last_bytes) / (sent - last_sent)
+                            : 0.0,
+           (dropped - last_dropped) / elapsed);
+    fflush(stdout);
+    last_ticks = ticks;
+    last_sim_ns = sim_ns;
+    last_send_ns = send_ns;
+    last_sent = sent;
+    last_dropped = dropped;
+    last_bytes = bytes;
+    last_ns = now;
+  }
+
+  atomic_store(&stop, true);
+  for (int i = 0; i < started; i++)
+    thrd_join(threads[i], NULL);
+  for (int i = 0; i < opened; i++)
+    close_shard(&shards[i]);
+  free(shards);
+  free(threads);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#ifndef PONG_SERVER_PROTO_H
+#define PONG_SERVER_PROTO_H
+
+// Wire format between pong_server and its clients over TCP. Every message is
+// framed as a little-endian u16 length of what follows, a u8 Server_Msg and
+// the payload. Fields are little-endian, see bytes.h.
+//
+// State carries a snapshot.h snapshot delta coded against the newest one
+// the client acknowledged in its Input, or a keyframe when the server no
+// longer has that one. Clients keep the last SERVER_SNAPSHOT_HISTORY
+// snapshots they decoded, by sequence number, to have the baseline at hand.
+
+#include <stdint.h>
+
+#include "snapshot.h"
+
+#define SERVER_PROTO_VERSION 2
+#define SERVER_DEFAULT_PORT 7700
+#define SERVER_FRAME_HEADER 3
+
+typedef enum {
+  // client -> server
+  // u8 version, u8 Server_Join_Mode; a full server closes the connection
+  Server_Msg_Join = 1,
+  // u8 Server_Key bits, u32 stamp echoed back in State, u32 newest State
+  // sequence decoded plus one (0 before the first)
+  Server_Msg_Input = 2,
+  // server -> client
+  Server_Msg_Welcome = 3, // u8 Side, u32 match id
+  // u32 tick, u32 stamp, u32 sequence, u8 how many sequences back the
+  // baseline is (0 for a keyframe), snapshot_encode bytes
+  Server_Msg_State = 4,
+} Server_Msg;
+
+typedef enum {
+  Server_Join_Ai,     // the server's Ai_Controller plays the other paddle
+  Server_Join_Versus, // paired with the next client asking for the same
+} Server_Join_Mode;
+
+// Keys are relative to the client's own paddle.
+typedef enum {
+  Server_Key_Up = 1 << 0,
+  Server_Key_Down = 1 << 1,
+} Server_Key;
+
+#define SERVER_JOIN_SIZE 2
+#define SERVER_INPUT_SIZE 9
+#define SERVER_WELCOME_SIZE 5
+#define SERVER_STATE_HEADER 13
+#define SERVER_STATE_MAX_SIZE (SERVER_STATE_HEADER + SNAPSHOT_MAX_SIZE)
+#define SERVER_SNAPSHOT_HISTORY 32 // baselines kept per match, power of two
+
+#endif
@@ -0,0 +1,366 @@
+#include "sim.h"
+
+#include <math.h>
+
+#include "bytes.h"
+#include "profile.h"
+
+void rng_seed(Rng *r, uint64_t seed) {
+  // splitmix64 so that nearby seeds give unrelated streams; xorshift must
+  // never be seeded with zero.
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  r->state = z ? z : 0x9E3779B97F4A7C15ull;
+}
+
+uint64_t rng_next(Rng *r) {
+  uint64_t x = r->state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  r->state = x;
+  return x * 0x2545F4914F6CDD1Dull;
+}
+
+int rng_range(Rng *r, int min, int max) {
+  if (max < min) {
+    int tmp = max;
+    max = min;
+    min = tmp;
+  }
+  uint64_t span = (uint64_t)((int64_t)max - min) + 1;
+  return min + (int)((rng_next(r) >> 11) % span);
+}
+
+void init_main_menu(Main_Menu_State *mms) {
+  mms->selected_item = Main_Menu_Item_Start_Coop;
+}
+
+void init_win_screen(Win_Screen_State *wss) {
+  wss->selected_item = Win_Screen_Item_Restart;
+}
+
+void init_game_field(State *s) {
+  s->left_paddle.x = PADDLE_WIDTH * 2.0;
+  s->left_paddle.h = PADDLE_HEIGHT;
+  s->left_paddle.y = SCREEN_HEIGHT / 2.0 - PADDLE_HEIGHT / 2.0;
+  s->left_paddle.w = PADDLE_WIDTH;
+
+  s->right_paddle.x = SCREEN_WIDTH - PADDLE_WIDTH * 3.0;
+  s->right_paddle.h = PADDLE_HEIGHT;
+  s->right_paddle.y = SCREEN_HEIGHT / 2.0 - PADDLE_HEIGHT / 2.0;
+  s->right_paddle.w = PADDLE_WIDTH;
+
+  s->ball.x = SCREEN_WIDTH / 2.0;
+  s->ball.y = SCREEN_HEIGHT / 2.0;
+}
+
+void init_state(State *s, uint64_t seed) {
+  s->step = Step_Main_Menu;
+  s->pause = true;
+  s->left_player_score = 0;
+  s->right_player_score = 0;
+  s->aspect_ratio = DEFAULT_ASPECT_RATIO;
+  rng_seed(&s->rng, seed);
+  init_game_field(s);
+  init_main_menu(&s->main_menu);
+  init_win_screen(&s->win_screen);
+
+  s->ball.vx = 0.3;
+  s->ball.vy = 0.3;
+}
+
+int is_ball_collide_with_paddle(Ball *b, Paddle *p, float aspect_ratio) {
+  if (p->x + p->w < b->x)
+    return false;
+
+  if (p->y + p->h < b->y)
+    return false;
+
+  if (b->x + BALL_SIZE < p->x)
+    return false;
+
+  if (b->y + BALL_SIZE * aspect_ratio < p->y)
+    return false;
+
+  return true;
+}
+
+void update_vy_after_paddle_collision(Ball *b, Paddle *p) {
+  float paddle_center_y = p->y + p->h / 2.0;
+  float ball_center_y = b->y + BALL_SIZE / 2.0;
+  float offset = sqrtf(fabs(paddle_center_y - ball_center_y));
+  if (ball_center_y < paddle_center_y)
+    b->vy -= offset;
+  else
+    b->vy += offset;
+}
+
+static void clamp_ball_velocity(Ball *b) {
+  if (b->vx > MAX_X_VELOCITY)
+    b->vx = MAX_X_VELOCITY;
+  else if (b->vx < -MAX_X_VELOCITY)
+    b->vx = -MAX_X_VELOCITY;
+  if (b->vy > MAX_Y_VELOCITY)
+    b->vy = MAX_Y_VELOCITY;
+  else if (b->vy < -MAX_Y_VELOCITY)
+    b->vy = -MAX_Y_VELOCITY;
+}
+
+void jitter_ball_after_collision(Ball *b, Rng *rng) {
+  b->vy *= rng_range(rng, 95, 110) / 100.0;
+  b->vx *= rng_range(rng, 95, 110) / 100.0;
+  clamp_ball_velocity(b);
+}
+
+static void score_point(State *s, Ball *ball, bool left_win) {
+  Paddle *left_paddle = &s->left_paddle;
+  Paddle *right_paddle = &s->right_paddle;
+  Rng *rng = &s->rng;
+
+  s->step = Step_Win_Screen;
+  s->win_screen.left_win = left_win;
+  if (left_win) {
+    s->left_player_score += 1;
+    ball->x = left_paddle->x + left_paddle->w;
+    ball->y = left_paddle->y + left_paddle->h / 2.0 + BALL_SIZE / 2.0;
+    ball->vx = -rng_range(rng, 20, 40) / 100.0;
+    ball->vy = rng_range(rng, -40, 40) / 100.0;
+  } else {
+    s->right_player_score += 1;
+    ball->x = right_paddle->x - PADDLE_WIDTH;
+    ball->y = right_paddle->y + right_paddle->h / 2.0;
+    ball->vx = rng_range(rng, 20, 40) / 100.0;
+    ball->vy = rng_range(rng, -40, 40) / 100.0;
+  }
+}
+
+typedef enum {
+  Ball_Hit_None,
+  Ball_Hit_Left_Paddle,
+  Ball_Hit_Right_Paddle,
+  Ball_Hit_Top,
+  Ball_Hit_Bottom,
+} Ball_Hit;
+
+// Swept collision: the ball travels to the earliest surface it reaches
+// within the step, bounces and goes on with the time that is left, so a fast
+// ball or a long step can not tunnel through a paddle. Crossing a paddle face
+// without overlapping the paddle scores the point. Returns the number of
+// bounces.
+int update_ball(State *s, float delta) {
+  Ball ball = s->ball;
+  Paddle *left_paddle = &s->left_paddle;
+  Paddle *right_paddle = &s->right_paddle;
+  Rng *rng = &s->rng;
+  float aspect_ratio = s->aspect_ratio;
+
+  // Ball positions at which it touches each surface.
+  float left_face = left_paddle->x + left_paddle->w;
+  float right_face = right_paddle->x - BALL_SIZE;
+  float top_wall = 0.0;
+  float bottom_wall = SCREEN_HEIGHT - BALL_SIZE * aspect_ratio;
+
+  float remaining = delta;
+  int bounce = 0;
+  for (; bounce <= MAX_BOUNCES_PER_STEP; bounce++) {
+    float vx = ball.vx * aspect_ratio;
+    float t = remaining;
+    Ball_Hit hit = Ball_Hit_None;
+
+    // Paddles win ties with the walls, like the old overlap test did.
+    if (vx < 0) {
+      float t_hit = fmaxf((left_face - ball.x) / vx, 0.0f);
+      if (t_hit <= t) {
+        t = t_hit;
+        hit = Ball_Hit_Left_Paddle;
+      }
+    } else if (vx > 0) {
+      float t_hit = fmaxf((right_face - ball.x) / vx, 0.0f);
+      if (t_hit <= t) {
+        t = t_hit;
+        hit = Ball_Hit_Right_Paddle;
+      }
+    }
+    if (ball.vy < 0) {
+      float t_hit = fmaxf((top_wall - ball.y) / ball.vy, 0.0f);
+      if (t_hit < t || (hit == Ball_Hit_None && t_hit <= t)) {
+        t = t_hit;
+        hit = Ball_Hit_Top;
+      }
+    } else if (ball.vy > 0) {
+      float t_hit = fmaxf((bottom_wall - ball.y) / ball.vy, 0.0f);
+      if (t_hit < t || (hit == Ball_Hit_None && t_hit <= t)) {
+        t = t_hit;
+        hit = Ball_Hit_Bottom;
+      }
+    }
+
+    ball.x += ball.vx * aspect_ratio * t;
+    ball.y += ball.vy * t;
+    remaining -= t;
+
+    switch (hit) {
+    case Ball_Hit_None:
+      s->ball = ball;
+      return bounce;
+    case Ball_Hit_Left_Paddle:
+      if (!is_ball_collide_with_paddle(&ball, left_paddle, aspect_ratio)) {
+        score_point(s, &ball, false);
+        s->ball = ball;
+        return bounce;
+      }
+      ball.x = left_face;
+      ball.vx = -ball.vx;
+      update_vy_after_paddle_collision(&ball, left_paddle);
+      break;
+    case Ball_Hit_Right_Paddle:
+      if (!is_ball_collide_with_paddle(&ball, right_paddle, aspect_ratio)) {
+        score_point(s, &ball, true);
+        s->ball = ball;
+        return bounce;
+      }
+      ball.x = right_face;
+      ball.vx = -ball.vx;
+      update_vy_after_paddle_collision(&ball, right_paddle);
+      break;
+    case Ball_Hit_Top:
+      ball.y = top_wall;
+      ball.vy = -ball.vy;
+      break;
+    case Ball_Hit_Bottom:
+      ball.y = bottom_wall;
+      ball.vy = -ball.vy;
+      break;
+    }
+
+    jitter_ball_after_collision(&ball, rng);
+  }
+
+  // Out of bounces: drop the rest of the step rather than spin.
+  s->ball = ball;
+  return bounce;
+}
+
+static int hold_field_shift(Input_Bit key) {
+  return INPUT_HOLD_SHIFT + 4 * __builtin_ctz(key);
+}
+
+Input input_set_hold(Input input, Input_Bit key, float fraction) {
+  int steps = (int)(fraction * INPUT_HOLD_STEPS + 0.5f);
+  input &= ~(key | (0xfu << hold_field_shift(key)));
+  if (steps <= 0)
+    return input;
+  if (steps >= INPUT_HOLD_STEPS)
+    return input | key;
+  return input | key | ((Input)steps << hold_field_shift(key));
+}
+
+float input_hold_time(Input input, Input_Bit key, float delta) {
+  if (!(input & key))
+    return 0;
+  Input steps = (input >> hold_field_shift(key)) & 0xf;
+  return steps ? delta * steps / INPUT_HOLD_STEPS : delta;
+}
+
+void move_paddle(Paddle *p, float up_time, float down_time) {
+  if (up_time > 0)
+    p->y -= PADDLE_SPEED * up_time;
+  if (down_time > 0)
+    p->y += PADDLE_SPEED * down_time;
+
+  if (p->y < 0) {
+    p->y = 0;
+  } else if (SCREEN_HEIGHT - p->h < p->y) {
+    p->y = SCREEN_HEIGHT - p->h;
+  }
+}
+
+void update_paddle(Paddle *p, bool up, bool down, float delta) {
+  move_paddle(p, up ? delta : 0, down ? delta : 0);
+}
+
+void update_paddles(State *s, Input input, float delta) {
+  move_paddle(&s->left_paddle, input_hold_time(input, Input_Left_Up, delta),
+              input_hold_time(input, Input_Left_Down, delta));
+  move_paddle(&s->right_paddle, input_hold_time(input, Input_Right_Up, delta),
+              input_hold_time(input, Input_Right_Down, delta));
+}
+
+void update_state(State *s, Input input, float delta) {
+  if (s->step == Step_Win_Screen && (input & Input_Restart)) {
+    init_game_field(s);
+    s->step = Step_Running;
+    s->pause = true;
+    return;
+  }
+  if (s->step != Step_Running)
+    return;
+
+  if (input & Input_Pause) {
+    s->pause = !s->pause;
+  }
+  if (!s->pause) {
+    update_paddles(s, input, delta);
+    uint64_t t = profile_begin();
+    update_ball(s, delta);
+    profile_end(Profile_Zone_Update_Ball, t);
+  }
+}
+
+bool is_state_static(const State *s) {
+  return s->step != Step_Running || s->pause;
+}
+
+void pack_state(const State *s, uint8_t out[STATE_BLOB_SIZE]) {
+  uint8_t *p = out;
+  p = put_f32(p, s->ball.x);
+  p = put_f32(p, s->ball.y);
+  p = put_f32(p, s->ball.vx);
+  p = put_f32(p, s->ball.vy);
+  const Paddle *paddles[] = {&s->left_paddle, &s->right_paddle};
+  for (int i = 0; i < 2; i++) {
+    p = put_f32(p, paddles[i]->x);
+    p = put_f32(p, paddles[i]->y);
+    p = put_f32(p, paddles[i]->h);
+    p = put_f32(p, paddles[i]->w);
+  }
+  p = put_u32(p, s->left_player_score);
+  p = put_u32(p, s->right_player_score);
+  *p++ = s->step;
+  *p++ = s->pause;
+  *p++ = s->main_menu.selected_item;
+  *p++ = s->win_screen.selected_item;
+  *p++ = s->win_screen.left_win;
+  p = put_u64(p, s->rng.state);
+  p = put_f32(p, s->aspect_ratio);
+}
+
+void unpack_state(const uint8_t in[STATE_BLOB_SIZE], State *s) {
+  const uint8_t *p = in;
+  uint32_t v;
+  p = get_f32(p, &s->ball.x);
+  p = get_f32(p, &s->ball.y);
+  p = get_f32(p, &s->ball.vx);
+  p = get_f32(p, &s->ball.vy);
+  Paddle *paddles[] = {&s->left_paddle, &s->right_paddle};
+  for (int i = 0; i < 2; i++) {
+    p = get_f32(p, &paddles[i]->x);
+    p = get_f32(p, &paddles[i]->y);
+    p = get_f32(p, &paddles[i]->h);
+    p = get_f32(p, &paddles[i]->w);
+  }
+  p = get_u32(p, &v);
+  s->left_player_score = (int32_t)v;
+  p = get_u32(p, &v);
+  s->right_player_score = (int32_t)v;
+  s->step = *p++;
+  s->pause = *p++;
+  s->main_menu.selected_item = *p++;
+  s->win_screen.selected_item = *p++;
+  s->win_screen.left_win = *p++;
+  p = get_u64(p, &s->rng.state);
+  p = get_f32(p, &s->aspect_ratio);
+}
@@ -0,0 +1,146 @@
+#ifndef PONG_SIM_H
+#define PONG_SIM_H
+
+// Headless simulation core. Nothing in here talks to raylib: the frontend
+// feeds an explicit delta, the sampled input and the per-match RNG lives in
+// State, so the same code runs in the window and on a GPU-less server.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PADDLE_WIDTH 0.03  // 3vw
+#define PADDLE_HEIGHT 0.20 // 20vh
+#define PADDLE_SPEED 1.0   // 1vw per sec
+#define BALL_SIZE 0.03     // 1vw
+#define SCREEN_WIDTH 1.0
+#define SCREEN_HEIGHT 1.0
+#define MAX_Y_VELOCITY 2.0
+#define MAX_X_VELOCITY 2.0
+#define DEFAULT_ASPECT_RATIO 2.0    // 800x400 window
+#define TICK_RATE 240               // simulation ticks per second
+#define TICK_DELTA (1.0f / TICK_RATE) // seconds per tick
+#define MAX_BOUNCES_PER_STEP 16     // swept collision gives up after this
+
+typedef enum {
+  Step_Running,
+  Step_Win_Screen,
+  Step_Main_Menu,
+} Step;
+
+typedef struct {
+  float x;
+  float y;
+  float vx;
+  float vy;
+} Ball;
+
+typedef struct {
+  float x;
+  float y;
+  float h;
+  float w;
+} Paddle;
+
+typedef enum {
+  Main_Menu_Item_Start_Coop,
+  Main_Menu_Item_Start_Solo,
+  Main_Menu_Item_Exit,
+  Main_Menu_Item_Cnt,
+} Main_Menu_Item;
+
+typedef struct {
+  Main_Menu_Item selected_item;
+} Main_Menu_State;
+
+typedef enum {
+  Win_Screen_Item_Restart,
+  Win_Screen_Item_Main_Menu,
+  Win_Screen_Item_Cnt,
+} Win_Screen_Item;
+
+typedef struct {
+  Win_Screen_Item selected_item;
+  bool left_win;
+} Win_Screen_State;
+
+// xorshift64*, seeded per match so a seed fully determines a match.
+typedef struct {
+  uint64_t state;
+} Rng;
+
+typedef struct {
+  Ball ball;
+  Paddle left_paddle;
+  Paddle right_paddle;
+  int left_player_score;
+  int right_player_score;
+  Step step;
+  bool pause;
+  Main_Menu_State main_menu;
+  Win_Screen_State win_screen;
+  Rng rng;
+  float aspect_ratio; // screen width / height, scales the ball vertically
+} State;
+
+// Input for one update, a bitmask of Input_Bit. Paddle bits are "key held",
+// Input_Pause is "pause key pressed" and toggles once per update it is set.
+// Input_Restart serves the next point from the win screen.
+typedef uint32_t Input;
+
+typedef enum {
+  Input_Left_Up = 1 << 0,
+  Input_Left_Down = 1 << 1,
+  Input_Right_Up = 1 << 2,
+  Input_Right_Down = 1 << 3,
+  Input_Pause = 1 << 4,
+  Input_Restart = 1 << 5,
+} Input_Bit;
+
+// Bits that are events rather than held keys; they must reach exactly one
+// update.
+#define INPUT_EDGE_BITS (Input_Pause | Input_Restart)
+
+// A paddle key held for only part of an update carries how long, in
+// sixteenths of the update, in a 4-bit field per paddle bit (field i belongs
+// to bit 1 << i). 0 means the whole update, so plain bitmasks still work.
+#define INPUT_HOLD_SHIFT 8
+#define INPUT_HOLD_STEPS 16
+#define INPUT_HOLD_MASK (0xffffu << INPUT_HOLD_SHIFT)
+
+// Fixed little-endian encoding of a whole State, used by replays.
+#define STATE_BLOB_SIZE 73
+
+void rng_seed(Rng *r, uint64_t seed);
+uint64_t rng_next(Rng *r);
+// Uniform integer in [min, max], same contract as GetRandomValue.
+int rng_range(Rng *r, int min, int max);
+
+void init_main_menu(Main_Menu_State *mms);
+void init_win_screen(Win_Screen_State *wss);
+void init_game_field(State *s);
+void init_state(State *s, uint64_t seed);
+
+int is_ball_collide_with_paddle(Ball *b, Paddle *p, float aspect_ratio);
+// Steers a ball that just bounced off `p` by how far from its center it hit.
+void update_vy_after_paddle_collision(Ball *b, Paddle *p);
+// Randomizes the speed a little after a bounce, within the velocity limits.
+void jitter_ball_after_collision(Ball *b, Rng *rng);
+int update_ball(State *s, float delta);
+// Sets paddle bit `key` held for `fraction` of the update, rounded to
+// sixteenths. Rounds to not held at all below half a sixteenth.
+Input input_set_hold(Input input, Input_Bit key, float fraction);
+// How long paddle bit `key` was held during an update of length `delta`.
+float input_hold_time(Input input, Input_Bit key, float delta);
+
+void move_paddle(Paddle *p, float up_time, float down_time);
+void update_paddle(Paddle *p, bool up, bool down, float delta);
+void update_paddles(State *s, Input input, float delta);
+void update_state(State *s, Input input, float delta);
+// True when update_state can't move anything without new input: menus, the
+// win screen and a paused match.
+bool is_state_static(const State *s);
+
+void pack_state(const State *s, uint8_t out[STATE_BLOB_SIZE]);
+void unpack_state(const uint8_t in[STATE_BLOB_SIZE], State *s);
+
+#endif
@@ -0,0 +1,212 @@
+#include "snapshot.h"
+
+#include <math.h>
+#include <string.h>
+
+// Widths a hot field delta can take, picked by a 2-bit class.
+static const int delta_widths[4] = {4, 8, 12, 16};
+
+typedef struct {
+  uint8_t *out;
+  int len;
+  uint64_t acc;
+  int bits;
+} Bit_Writer;
+
+typedef struct {
+  const uint8_t *in;
+  int len;
+  int pos;
+  uint64_t acc;
+  int bits;
+  bool overrun;
+} Bit_Reader;
+
+static void put_bits(Bit_Writer *w, uint32_t value, int bits) {
+  w->acc |= (uint64_t)value << w->bits;
+  w->bits += bits;
+  while (w->bits >= 8) {
+    w->out[w->len++] = (uint8_t)w->acc;
+    w->acc >>= 8;
+    w->bits -= 8;
+  }
+}
+
+static int flush_bits(Bit_Writer *w) {
+  if (w->bits > 0)
+    w->out[w->len++] = (uint8_t)w->acc;
+  return w->len;
+}
+
+static uint32_t get_bits(Bit_Reader *r, int bits) {
+  while (r->bits < bits) {
+    if (r->pos == r->len) {
+      r->overrun = true;
+      return 0;
+    }
+    r->acc |= (uint64_t)r->in[r->pos++] << r->bits;
+    r->bits += 8;
+  }
+  uint32_t value = r->acc & ((1u << bits) - 1);
+  r->acc >>= bits;
+  r->bits -= bits;
+  return value;
+}
+
+static uint16_t quantize(float v, float min, float max, int bits) {
+  uint32_t top = (1u << bits) - 1;
+  float t = (v - min) / (max - min);
+  if (!(t > 0))
+    return 0;
+  if (t >= 1)
+    return top;
+  return (uint16_t)lrintf(t * top);
+}
+
+static float dequantize(uint16_t q, float min, float max, int bits) {
+  return min + (max - min) * q / (float)((1u << bits) - 1);
+}
+
+static uint16_t quantize_pos(float v) {
+  return quantize(v, SNAPSHOT_POS_MIN, SNAPSHOT_POS_MAX, 16);
+}
+
+static float dequantize_pos(uint16_t q) {
+  return dequantize(q, SNAPSHOT_POS_MIN, SNAPSHOT_POS_MAX, 16);
+}
+
+static uint16_t quantize_vel(float v) {
+  return quantize(v, -SNAPSHOT_VEL_MAX, SNAPSHOT_VEL_MAX, SNAPSHOT_VEL_BITS);
+}
+
+static float dequantize_vel(uint16_t q) {
+  return dequantize(q, -SNAPSHOT_VEL_MAX, SNAPSHOT_VEL_MAX, SNAPSHOT_VEL_BITS);
+}
+
+static uint8_t clamp_score(int score) {
+  return score < 0 ? 0 : score > 255 ? 255 : score;
+}
+
+void snapshot_quantize(const State *s, Snapshot *out) {
+  out->hot[Snapshot_Ball_X] = quantize_pos(s->ball.x);
+  out->hot[Snapshot_Ball_Y] = quantize_pos(s->ball.y);
+  out->hot[Snapshot_Ball_Vx] = quantize_vel(s->ball.vx);
+  out->hot[Snapshot_Ball_Vy] = quantize_vel(s->ball.vy);
+  out->hot[Snapshot_Left_Y] = quantize_pos(s->left_paddle.y);
+  out->hot[Snapshot_Right_Y] = quantize_pos(s->right_paddle.y);
+  out->geometry[Snapshot_Left_X] = quantize_pos(s->left_paddle.x);
+  out->geometry[Snapshot_Left_W] = quantize_pos(s->left_paddle.w);
+  out->geometry[Snapshot_Left_H] = quantize_pos(s->left_paddle.h);
+  out->geometry[Snapshot_Right_X] = quantize_pos(s->right_paddle.x);
+  out->geometry[Snapshot_Right_W] = quantize_pos(s->right_paddle.w);
+  out->geometry[Snapshot_Right_H] = quantize_pos(s->right_paddle.h);
+  out->left_score = clamp_score(s->left_player_score);
+  out->right_score = clamp_score(s->right_player_score);
+  out->flags = (s->step & 3) | s->pause << 2 | s->win_screen.left_win << 3 |
+               (s->main_menu.selected_item & 3) << 4 |
+               (s->win_screen.selected_item & 1) << 6;
+  out->aspect = quantize(s->aspect_ratio, 0, 65535 / SNAPSHOT_ASPECT_SCALE, 16);
+}
+
+void snapshot_dequantize(const Snapshot *q, State *out) {
+  memset(out, 0, sizeof(*out));
+  out->ball.x = dequantize_pos(q->hot[Snapshot_Ball_X]);
+  out->ball.y = dequantize_pos(q->hot[Snapshot_Ball_Y]);
+  out->ball.vx = dequantize_vel(q->hot[Snapshot_Ball_Vx]);
+  out->ball.vy = dequantize_vel(q->hot[Snapshot_Ball_Vy]);
+  out->left_paddle.y = dequantize_pos(q->hot[Snapshot_Left_Y]);
+  out->right_paddle.y = dequantize_pos(q->hot[Snapshot_Right_Y]);
+  out->left_paddle.x = dequantize_pos(q->geometry[Snapshot_Left_X]);
+  out->left_paddle.w = dequantize_pos(q->geometry[Snapshot_Left_W]);
+  out->left_paddle.h = dequantize_pos(q->geometry[Snapshot_Left_H]);
+  out->right_paddle.x = dequantize_pos(q->geometry[Snapshot_Right_X]);
+  out->right_paddle.w = dequantize_pos(q->geometry[Snapshot_Right_W]);
+  out->right_paddle.h = dequantize_pos(q->geometry[Snapshot_Right_H]);
+  out->left_player_score = q->left_score;
+  out->right_player_score = q->right_score;
+  out->step = q->flags & 3;
+  out->pause = q->flags >> 2 & 1;
+  out->win_screen.left_win = q->flags >> 3 & 1;
+  out->main_menu.selected_item = q->flags >> 4 & 3;
+  out->win_screen.selected_item = q->flags >> 6 & 1;
+  out->aspect_ratio = q->aspect / SNAPSHOT_ASPECT_SCALE;
+}
+
+// Layout, LSB first: per hot field a changed bit, then a 2-bit width class
+// and the zigzag delta; then a changed bit and the raw values for geometry,
+// scores, flags and aspect.
+int snapshot_encode(const Snapshot *cur, const Snapshot *base, uint8_t *out) {
+  static const Snapshot zero;
+  if (!base)
+    base = &zero;
+  Bit_Writer w = {out, 0, 0, 0};
+
+  for (int i = 0; i < Snapshot_Hot_Cnt; i++) {
+    int16_t delta = (int16_t)(cur->hot[i] - base->hot[i]);
+    if (delta == 0) {
+      put_bits(&w, 0, 1);
+      continue;
+    }
+    uint16_t zigzag =
+        (uint16_t)((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+    int cls = 0;
+    while (zigzag >> delta_widths[cls])
+      cls++;
+    put_bits(&w, 1 | cls << 1, 3);
+    put_bits(&w, zigzag, delta_widths[cls]);
+  }
+
+  bool geometry = memcmp(cur->geometry, base->geometry,
+                         sizeof(cur->geometry)) != 0;
+  put_bits(&w, geometry, 1);
+  for (int i = 0; geometry && i < Snapshot_Geometry_Cnt; i++)
+    put_bits(&w, cur->geometry[i], 16);
+
+  bool scores = cur->left_score != base->left_score ||
+                cur->right_score != base->right_score;
+  put_bits(&w, scores, 1);
+  if (scores)
+    put_bits(&w, cur->left_score | cur->right_score << 8, 16);
+
+  bool flags = cur->flags != base->flags;
+  put_bits(&w, flags, 1);
+  if (flags)
+    put_bits(&w, cur->flags, 7);
+
+  bool aspect = cur->aspect != base->aspect;
+  put_bits(&w, aspect, 1);
+  if (aspect)
+    put_bits(&w, cur->aspect, 16);
+  return flush_bits(&w);
+}
+
+bool snapshot_decode(const uint8_t *in, int len, const Snapshot *base,
+                     Snapshot *out) {
+  static const Snapshot zero;
+  if (!base)
+    base = &zero;
+  *out = *base;
+  Bit_Reader r = {in, len, 0, 0, 0, false};
+
+  for (int i = 0; i < Snapshot_Hot_Cnt; i++) {
+    if (!get_bits(&r, 1))
+      continue;
+    int cls = get_bits(&r, 2);
+    uint16_t zigzag = get_bits(&r, delta_widths[cls]);
+    int16_t delta = (int16_t)((zigzag >> 1) ^ -(zigzag & 1));
+    out->hot[i] = base->hot[i] + delta;
+  }
+  if (get_bits(&r, 1))
+    for (int i = 0; i < Snapshot_Geometry_Cnt; i++)
+      out->geometry[i] = get_bits(&r, 16);
+  if (get_bits(&r, 1)) {
+    uint32_t scores = get_bits(&r, 16);
+    out->left_score = scores & 0xff;
+    out->right_score = scores >> 8;
+  }
+  if (get_bits(&r, 1))
+    out->flags = get_bits(&r, 7);
+  if (get_bits(&r, 1))
+    out->aspect = get_bits(&r, 16);
+  return !r.overrun;
+}
@@ -0,0 +1,67 @@
+#ifndef PONG_SNAPSHOT_H
+#define PONG_SNAPSHOT_H
+
+// Lossy, bit-packed snapshots of what a viewer needs from a State: positions
+// quantized to 16 bits, velocities to 12, step, pause and menu selections
+// packed into a few bits, scores into 8. Encoded against a baseline the
+// receiver already has, each field costs one bit when unchanged and a short
+// zigzag delta when it moved. The RNG is not sent, so a snapshot can be
+// drawn but not simulated further; replays keep using pack_state.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+#define SNAPSHOT_POS_MIN -0.25f // positions may overshoot the field a little
+#define SNAPSHOT_POS_MAX 1.25f
+#define SNAPSHOT_VEL_MAX 2.0f // update_ball clamps to MAX_[XY]_VELOCITY
+#define SNAPSHOT_VEL_BITS 12
+#define SNAPSHOT_ASPECT_SCALE 1024.0f
+// Worst case, a keyframe; deltas are usually under 10 bytes.
+#define SNAPSHOT_MAX_SIZE 48
+
+typedef enum {
+  Snapshot_Ball_X,
+  Snapshot_Ball_Y,
+  Snapshot_Ball_Vx,
+  Snapshot_Ball_Vy,
+  Snapshot_Left_Y,
+  Snapshot_Right_Y,
+  Snapshot_Hot_Cnt,
+} Snapshot_Hot;
+
+typedef enum {
+  Snapshot_Left_X,
+  Snapshot_Left_W,
+  Snapshot_Left_H,
+  Snapshot_Right_X,
+  Snapshot_Right_W,
+  Snapshot_Right_H,
+  Snapshot_Geometry_Cnt,
+} Snapshot_Geometry;
+
+// Quantized State. Fields that change every tick are `hot` and delta coded
+// one by one, the rest change together in rare groups.
+typedef struct {
+  uint16_t hot[Snapshot_Hot_Cnt];
+  uint16_t geometry[Snapshot_Geometry_Cnt];
+  uint8_t left_score;
+  uint8_t right_score;
+  uint8_t flags; // step:2 pause:1 left_win:1 menu item:2 win item:1
+  uint16_t aspect;
+} Snapshot;
+
+void snapshot_quantize(const State *s, Snapshot *out);
+// Fills the drawable part of a State; the RNG is zeroed.
+void snapshot_dequantize(const Snapshot *q, State *out);
+
+// Encodes `cur` against `base`, or as a keyframe when base is NULL. Returns
+// the size in bytes, at most SNAPSHOT_MAX_SIZE.
+int snapshot_encode(const Snapshot *cur, const Snapshot *base, uint8_t *out);
+// Decodes against the same base the encoder used. Returns false on a
+// truncated buffer.
+bool snapshot_decode(const uint8_t *in, int len, const Snapshot *base,
+                     Snapshot *out);
+
+#endif
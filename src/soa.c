@@ -0,0 +1,273 @@
+#include "soa.h"
+
+#include <stdbool.h>
+
+// Lanes whose swept ball box comes this close to a wall or a paddle band go
+// through the scalar path. It only needs to cover the float vs double
+// rounding differences between the kernel and update_ball.
+#define SOA_EVENT_MARGIN 1e-3f
+
+// Define PONG_SCALAR_KERNELS to force the plain C lanes, e.g. to compare
+// against the vector builds.
+#if defined(__AVX2__) && !defined(PONG_SCALAR_KERNELS)
+#include <immintrin.h>
+
+#define VEC_WIDTH 8
+#define KERNEL_NAME "avx2"
+
+typedef __m256 Vec;
+typedef __m256 Mask;
+
+static inline Vec vec_load(const float *p) { return _mm256_load_ps(p); }
+static inline void vec_store(float *p, Vec v) { _mm256_store_ps(p, v); }
+static inline Vec vec_set1(float f) { return _mm256_set1_ps(f); }
+static inline Vec vec_add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+static inline Vec vec_sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+static inline Vec vec_mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+static inline Vec vec_min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+static inline Vec vec_max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+static inline Mask vec_lt(Vec a, Vec b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+static inline Mask vec_le(Vec a, Vec b) {
+  return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+}
+static inline Mask mask_or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+static inline Mask mask_and(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+static inline Mask mask_andnot(Mask a, Mask b) {
+  return _mm256_andnot_ps(b, a); // a & ~b
+}
+static inline Vec vec_select(Mask m, Vec a, Vec b) {
+  return _mm256_blendv_ps(b, a, m);
+}
+static inline uint32_t mask_bits(Mask m) { return _mm256_movemask_ps(m); }
+static inline Mask mask_from_bits(uint32_t bits) {
+  __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  __m256i v = _mm256_and_si256(_mm256_set1_epi32(bits), lane_bits);
+  return _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, lane_bits));
+}
+
+#elif defined(__SSE2__) && !defined(PONG_SCALAR_KERNELS)
+#include <emmintrin.h>
+
+#define VEC_WIDTH 4
+#define KERNEL_NAME "sse2"
+
+typedef __m128 Vec;
+typedef __m128 Mask;
+
+static inline Vec vec_load(const float *p) { return _mm_load_ps(p); }
+static inline void vec_store(float *p, Vec v) { _mm_store_ps(p, v); }
+static inline Vec vec_set1(float f) { return _mm_set1_ps(f); }
+static inline Vec vec_add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+static inline Vec vec_sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+static inline Vec vec_mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+static inline Vec vec_min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+static inline Vec vec_max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+static inline Mask vec_lt(Vec a, Vec b) { return _mm_cmplt_ps(a, b); }
+static inline Mask vec_le(Vec a, Vec b) { return _mm_cmple_ps(a, b); }
+static inline Mask mask_or(Mask a, Mask b) { return _mm_or_ps(a, b); }
+static inline Mask mask_and(Mask a, Mask b) { return _mm_and_ps(a, b); }
+static inline Mask mask_andnot(Mask a, Mask b) {
+  return _mm_andnot_ps(b, a); // a & ~b
+}
+static inline Vec vec_select(Mask m, Vec a, Vec b) {
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+static inline uint32_t mask_bits(Mask m) { return _mm_movemask_ps(m); }
+static inline Mask mask_from_bits(uint32_t bits) {
+  __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+  __m128i v = _mm_and_si128(_mm_set1_epi32(bits), lane_bits);
+  return _mm_castsi128_ps(_mm_cmpeq_epi32(v, lane_bits));
+}
+
+#else
+
+#define VEC_WIDTH 1
+#define KERNEL_NAME "scalar"
+
+typedef float Vec;
+typedef bool Mask;
+
+static inline Vec vec_load(const float *p) { return *p; }
+static inline void vec_store(float *p, Vec v) { *p = v; }
+static inline Vec vec_set1(float f) { return f; }
+static inline Vec vec_add(Vec a, Vec b) { return a + b; }
+static inline Vec vec_sub(Vec a, Vec b) { return a - b; }
+static inline Vec vec_mul(Vec a, Vec b) { return a * b; }
+static inline Vec vec_min(Vec a, Vec b) { return a < b ? a : b; }
+static inline Vec vec_max(Vec a, Vec b) { return a > b ? a : b; }
+static inline Mask vec_lt(Vec a, Vec b) { return a < b; }
+static inline Mask vec_le(Vec a, Vec b) { return a <= b; }
+static inline Mask mask_or(Mask a, Mask b) { return a || b; }
+static inline Mask mask_and(Mask a, Mask b) { return a && b; }
+static inline Mask mask_andnot(Mask a, Mask b) { return a && !b; }
+static inline Vec vec_select(Mask m, Vec a, Vec b) { return m ? a : b; }
+static inline uint32_t mask_bits(Mask m) { return m; }
+static inline Mask mask_from_bits(uint32_t bits) { return bits & 1; }
+
+#endif
+
+const char *soa_kernel_name(void) { return KERNEL_NAME; }
+
+void soa_store_lane(Match_Block *b, int lane, const State *s) {
+  b->lanes[lane] = *s;
+  b->ball_x[lane] = s->ball.x;
+  b->ball_y[lane] = s->ball.y;
+  b->ball_vx[lane] = s->ball.vx;
+  b->ball_vy[lane] = s->ball.vy;
+  b->left_x[lane] = s->left_paddle.x;
+  b->left_y[lane] = s->left_paddle.y;
+  b->left_w[lane] = s->left_paddle.w;
+  b->left_h[lane] = s->left_paddle.h;
+  b->right_x[lane] = s->right_paddle.x;
+  b->right_y[lane] = s->right_paddle.y;
+  b->right_w[lane] = s->right_paddle.w;
+  b->right_h[lane] = s->right_paddle.h;
+  b->aspect_ratio[lane] = s->aspect_ratio;
+}
+
+void soa_load_lane(const Match_Block *b, int lane, State *s) {
+  *s = b->lanes[lane];
+  s->ball.x = b->ball_x[lane];
+  s->ball.y = b->ball_y[lane];
+  s->ball.vx = b->ball_vx[lane];
+  s->ball.vy = b->ball_vy[lane];
+  s->left_paddle.x = b->left_x[lane];
+  s->left_paddle.y = b->left_y[lane];
+  s->left_paddle.w = b->left_w[lane];
+  s->left_paddle.h = b->left_h[lane];
+  s->right_paddle.x = b->right_x[lane];
+  s->right_paddle.y = b->right_y[lane];
+  s->right_paddle.w = b->right_w[lane];
+  s->right_paddle.h = b->right_h[lane];
+  s->aspect_ratio = b->aspect_ratio[lane];
+}
+
+static uint32_t input_bits(const Match_Block *b, Input bit) {
+  uint32_t bits = 0;
+  for (int lane = 0; lane < SOA_LANES; lane++)
+    if (b->input[lane] & bit)
+      bits |= 1u << lane;
+  return bits;
+}
+
+// Same operations as update_paddle, masked to the active lanes.
+static void update_paddle_lanes(float *ys, const float *hs, uint32_t up_bits,
+                                uint32_t down_bits, uint32_t active_bits,
+                                float delta) {
+  Vec d = vec_set1(delta);
+  Vec zero = vec_set1(0.0f);
+  Vec one = vec_set1(SCREEN_HEIGHT);
+
+  for (int base = 0; base < SOA_LANES; base += VEC_WIDTH) {
+    Mask active = mask_from_bits(active_bits >> base);
+    Mask up = mask_and(active, mask_from_bits(up_bits >> base));
+    Mask down = mask_and(active, mask_from_bits(down_bits >> base));
+
+    Vec y = vec_load(ys + base);
+    Vec limit = vec_sub(one, vec_load(hs + base));
+    y = vec_select(up, vec_sub(y, d), y);
+    y = vec_select(down, vec_add(y, d), y);
+
+    Mask below = mask_and(active, vec_lt(y, zero));
+    Mask above = mask_andnot(mask_and(active, vec_lt(limit, y)), below);
+    y = vec_select(below, zero, y);
+    y = vec_select(above, limit, y);
+    vec_store(ys + base, y);
+  }
+}
+
+// Integrates every active ball and returns the lanes that may collide or
+// score this step. Those keep their pre-step position for the scalar path.
+static uint32_t update_ball_lanes(Match_Block *b, uint32_t active_bits,
+                                  float delta) {
+  Vec d = vec_set1(delta);
+  Vec margin = vec_set1(SOA_EVENT_MARGIN);
+  Vec size = vec_set1(BALL_SIZE);
+  Vec top = vec_set1(0.0f);
+  Vec bottom = vec_set1(SCREEN_HEIGHT);
+  uint32_t event_bits = 0;
+
+  for (int base = 0; base < SOA_LANES; base += VEC_WIDTH) {
+    Mask active = mask_from_bits(active_bits >> base);
+
+    Vec x0 = vec_load(b->ball_x + base);
+    Vec y0 = vec_load(b->ball_y + base);
+    Vec vx = vec_load(b->ball_vx + base);
+    Vec vy = vec_load(b->ball_vy + base);
+    Vec ar = vec_load(b->aspect_ratio + base);
+
+    Vec x1 = vec_add(x0, vec_mul(vec_mul(vx, ar), d));
+    Vec y1 = vec_add(y0, vec_mul(vy, d));
+
+    // Swept box of the ball over the step, padded by the margin.
+    Vec min_x = vec_sub(vec_min(x0, x1), margin);
+    Vec max_x = vec_add(vec_add(vec_max(x0, x1), size), margin);
+    Vec min_y = vec_sub(vec_min(y0, y1), margin);
+    Vec max_y =
+        vec_add(vec_add(vec_max(y0, y1), vec_mul(size, ar)), margin);
+
+    // Anything behind the left paddle face is a hit or a point, whatever the
+    // vertical overlap, so the paddle AABB reduces to a band test here.
+    Vec left_face =
+        vec_add(vec_load(b->left_x + base), vec_load(b->left_w + base));
+    Vec right_face = vec_load(b->right_x + base);
+
+    Mask event = vec_le(min_y, top);
+    event = mask_or(event, vec_le(bottom, max_y));
+    event = mask_or(event, vec_le(min_x, left_face));
+    event = mask_or(event, vec_le(right_face, max_x));
+    event = mask_and(active, event);
+
+    Mask move = mask_andnot(active, event);
+    vec_store(b->ball_x + base, vec_select(move, x1, x0));
+    vec_store(b->ball_y + base, vec_select(move, y1, y0));
+
+    event_bits |= mask_bits(event) << base;
+  }
+
+  return event_bits;
+}
+
+void soa_update_block(Match_Block *b, float delta) {
+  uint32_t active_bits = 0;
+
+  for (int lane = 0; lane < SOA_LANES; lane++) {
+    if (!(b->used_bits & 1u << lane))
+      continue;
+
+    State *s = &b->lanes[lane];
+    if (s->step == Step_Running && !s->pause &&
+        !(b->input[lane] & (Input_Pause | INPUT_HOLD_MASK))) {
+      active_bits |= 1u << lane;
+      continue;
+    }
+
+    // Paused, in a menu, toggling pause or holding a key for part of the
+    // step: nothing to vectorize.
+    State tmp;
+    soa_load_lane(b, lane, &tmp);
+    update_state(&tmp, b->input[lane], delta);
+    soa_store_lane(b, lane, &tmp);
+  }
+
+  if (!active_bits)
+    return;
+
+  update_paddle_lanes(b->left_y, b->left_h, input_bits(b, Input_Left_Up),
+                      input_bits(b, Input_Left_Down), active_bits, delta);
+  update_paddle_lanes(b->right_y, b->right_h, input_bits(b, Input_Right_Up),
+                      input_bits(b, Input_Right_Down), active_bits, delta);
+
+  uint32_t event_bits = update_ball_lanes(b, active_bits, delta);
+  while (event_bits) {
+    int lane = __builtin_ctz(event_bits);
+    event_bits &= event_bits - 1;
+
+    State tmp;
+    soa_load_lane(b, lane, &tmp);
+    update_ball(&tmp, delta);
+    soa_store_lane(b, lane, &tmp);
+  }
+}
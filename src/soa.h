@@ -0,0 +1,50 @@
+#ifndef PONG_SOA_H
+#define PONG_SOA_H
+
+// Structure-of-arrays storage for a block of independent matches, stepped
+// with SSE2/AVX2 kernels. The hot Ball/Paddle floats live in one contiguous
+// array per field; everything else stays in a per-lane State.
+//
+// The kernels integrate paddles and balls for every lane at once and only
+// classify the swept ball box against walls and paddle bands. Lanes that may
+// touch anything are stepped by the scalar update_ball, so results are
+// bit-identical to stepping each State on its own (build with
+// -ffp-contract=off so the compiler does not fuse the scalar reference).
+
+#include <stdint.h>
+
+#include "sim.h"
+
+#define SOA_LANES 16
+
+typedef struct {
+  _Alignas(64) float ball_x[SOA_LANES];
+  _Alignas(64) float ball_y[SOA_LANES];
+  _Alignas(64) float ball_vx[SOA_LANES];
+  _Alignas(64) float ball_vy[SOA_LANES];
+  _Alignas(64) float left_x[SOA_LANES];
+  _Alignas(64) float left_y[SOA_LANES];
+  _Alignas(64) float left_w[SOA_LANES];
+  _Alignas(64) float left_h[SOA_LANES];
+  _Alignas(64) float right_x[SOA_LANES];
+  _Alignas(64) float right_y[SOA_LANES];
+  _Alignas(64) float right_w[SOA_LANES];
+  _Alignas(64) float right_h[SOA_LANES];
+  _Alignas(64) float aspect_ratio[SOA_LANES];
+  Input input[SOA_LANES];
+  uint32_t used_bits; // lanes holding a match, bit i for lane i
+  // Cold part of each match. Its ball and paddles are stale, go through
+  // soa_load_lane to get a complete State.
+  State lanes[SOA_LANES];
+} Match_Block;
+
+// Name of the kernel compiled in: "avx2", "sse2" or "scalar".
+const char *soa_kernel_name(void);
+
+void soa_store_lane(Match_Block *b, int lane, const State *s);
+void soa_load_lane(const Match_Block *b, int lane, State *s);
+
+// update_state for every used lane with b->input as that lane's input.
+void soa_update_block(Match_Block *b, float delta);
+
+#endif
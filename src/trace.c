@@ -0,0 +1,88 @@
+#include "trace.h"
+
+#include <time.h>
+
+#include "profile.h"
+
+#define TRACE_POLL_NS 1000000 // writer sleep when it has caught up
+
+static void write_span(Trace_Writer *t, const char *name, uint64_t begin_ns,
+                       uint64_t end_ns) {
+  fprintf(t->file,
+          ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+          "\"ts\":%.3f,\"dur\":%.3f}",
+          name, (begin_ns - t->origin_ns) / 1e3, (end_ns - begin_ns) / 1e3);
+}
+
+static void write_frame(Trace_Writer *t, const Profile_Frame *f) {
+  if (t->origin_ns == 0)
+    t->origin_ns = f->begin_ns;
+
+  write_span(t, profile_zone_names[Profile_Zone_Frame], f->begin_ns,
+             f->end_ns);
+  for (uint32_t i = 0; i < f->span_cnt && i < PROFILE_MAX_SPANS; i++) {
+    const Profile_Span *span = &f->spans[i];
+    write_span(t, profile_zone_names[span->zone], span->begin_ns,
+               span->end_ns);
+  }
+  t->written++;
+}
+
+// Writes all frames published so far. Returns false if there were none.
+static bool drain(Trace_Writer *t) {
+  static Profile_Frame frame;
+  uint64_t head = atomic_load(&profile_ring.head);
+  if (t->next_frame == head)
+    return false;
+
+  for (; t->next_frame < head; t->next_frame++) {
+    if (profile_read_frame(t->next_frame, &frame))
+      write_frame(t, &frame);
+    else
+      t->dropped++;
+  }
+  return true;
+}
+
+static int writer_main(void *arg) {
+  Trace_Writer *t = arg;
+  struct timespec poll = {0, TRACE_POLL_NS};
+
+  while (!atomic_load(&t->stop)) {
+    if (!drain(t))
+      thrd_sleep(&poll, NULL);
+  }
+  drain(t);
+  return 0;
+}
+
+bool trace_start(Trace_Writer *t, const char *path) {
+  t->file = fopen(path, "w");
+  if (!t->file)
+    return false;
+
+  atomic_init(&t->stop, false);
+  t->next_frame = atomic_load(&profile_ring.head);
+  t->origin_ns = 0;
+  t->written = 0;
+  t->dropped = 0;
+
+  fprintf(t->file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":1,\"args\":{\"name\":\"main loop\"}}");
+
+  if (thrd_create(&t->thread, writer_main, t) != thrd_success) {
+    fclose(t->file);
+    t->file = NULL;
+    return false;
+  }
+  return true;
+}
+
+void trace_stop(Trace_Writer *t) {
+  atomic_store(&t->stop, true);
+  thrd_join(t->thread, NULL);
+  fprintf(t->file, "\n]}\n");
+  fclose(t->file);
+  t->file = NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef PONG_TRACE_H
+#define PONG_TRACE_H
+
+// Streams profile_ring frames to a Chrome Trace Event JSON file (loads in
+// chrome://tracing and ui.perfetto.dev). A background thread follows the
+// ring with its own cursor, so the frame loop never blocks on file IO.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+
+typedef struct {
+  FILE *file;
+  thrd_t thread;
+  atomic_bool stop;
+  uint64_t next_frame;
+  uint64_t origin_ns;
+  uint64_t written;
+  uint64_t dropped; // frames overwritten before the writer got to them
+} Trace_Writer;
+
+bool trace_start(Trace_Writer *t, const char *path);
+// Writes every frame published so far and closes the file.
+void trace_stop(Trace_Writer *t);
+
+#endif
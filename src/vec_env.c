@@ -0,0 +1,143 @@
+#include "vec_env.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "policy.h"
+
+void init_vec_env_config(Vec_Env_Config *c) {
+  c->ticks_per_step = 4; // 60 decisions per second
+  c->max_episode_ticks = (uint64_t)TICK_RATE * 60;
+  c->ai_opponent = true;
+  init_ai_config(&c->opponent);
+}
+
+static void *alloc_buffer(int cnt, size_t size) {
+  // aligned_alloc wants a multiple of the alignment.
+  size_t bytes = ((size_t)cnt * size + 63) & ~(size_t)63;
+  void *p = aligned_alloc(64, bytes ? bytes : 64);
+  if (p)
+    memset(p, 0, bytes);
+  return p;
+}
+
+bool vec_env_init(Vec_Env *e, int env_cnt, const Vec_Env_Config *c) {
+  memset(e, 0, sizeof(*e));
+  e->env_cnt = env_cnt;
+  e->config = *c;
+  if (e->config.ticks_per_step < 1)
+    e->config.ticks_per_step = 1;
+
+  e->states = alloc_buffer(env_cnt, sizeof(State));
+  e->opponents = alloc_buffer(env_cnt, sizeof(Ai_Controller));
+  e->episode_ticks = alloc_buffer(env_cnt, sizeof(uint64_t));
+  e->obs = alloc_buffer(env_cnt, sizeof(Pong_Observation));
+  e->final_obs = alloc_buffer(env_cnt, sizeof(Pong_Observation));
+  e->rewards = alloc_buffer(env_cnt, sizeof(float));
+  e->dones = alloc_buffer(env_cnt, sizeof(uint8_t));
+  if (!e->states || !e->opponents || !e->episode_ticks || !e->obs ||
+      !e->final_obs || !e->rewards || !e->dones) {
+    vec_env_free(e);
+    return false;
+  }
+  return true;
+}
+
+void vec_env_free(Vec_Env *e) {
+  free(e->states);
+  free(e->opponents);
+  free(e->episode_ticks);
+  free(e->obs);
+  free(e->final_obs);
+  free(e->rewards);
+  free(e->dones);
+  memset(e, 0, sizeof(*e));
+}
+
+void vec_env_reset(Vec_Env *e, const uint64_t *seeds) {
+  for (int i = 0; i < e->env_cnt; i++) {
+    State *s = &e->states[i];
+    init_state(s, seeds[i]);
+    s->step = Step_Running;
+    s->pause = false;
+    ai_init(&e->opponents[i], Side_Left, &e->config.opponent);
+    e->episode_ticks[i] = 0;
+    e->rewards[i] = 0;
+    e->dones[i] = Env_Done_None;
+    policy_observe_state(s, Side_Right, &e->obs[i]);
+  }
+}
+
+// Runs one environment for ticks_per_step ticks or until the episode ends.
+static Env_Done step_env(Vec_Env *e, int i, uint8_t action, float *reward) {
+  State *s = &e->states[i];
+  Input agent = policy_action_input(Side_Right, action);
+
+  for (int k = 0; k < e->config.ticks_per_step; k++) {
+    Input input = agent;
+    if (e->config.ai_opponent)
+      input |= ai_decide_state(&e->opponents[i], s);
+    update_state(s, input, TICK_DELTA);
+    e->episode_ticks[i]++;
+
+    if (s->step == Step_Win_Screen) {
+      *reward = s->win_screen.left_win ? -1.0f : 1.0f;
+      return Env_Done_Point;
+    }
+    if (e->config.max_episode_ticks != 0 &&
+        e->episode_ticks[i] >= e->config.max_episode_ticks)
+      return Env_Done_Truncated;
+  }
+  return Env_Done_None;
+}
+
+void vec_env_step(Vec_Env *e, const uint8_t *actions) {
+  for (int i = 0; i < e->env_cnt; i++) {
+    State *s = &e->states[i];
+    float reward = 0;
+    Env_Done done = step_env(e, i, actions[i], &reward);
+
+    if (done != Env_Done_None) {
+      // Auto-reset: serve the next point, scores and RNG carry on.
+      policy_observe_state(s, Side_Right, &e->final_obs[i]);
+      init_game_field(s);
+      s->step = Step_Running;
+      e->episode_ticks[i] = 0;
+    }
+    e->rewards[i] = reward;
+    e->dones[i] = done;
+    policy_observe_state(s, Side_Right, &e->obs[i]);
+  }
+}
+
+Vec_Env *vec_env_create(int env_cnt, int ticks_per_step,
+                        uint64_t max_episode_ticks, bool ai_opponent) {
+  Vec_Env_Config c;
+  init_vec_env_config(&c);
+  c.ticks_per_step = ticks_per_step;
+  c.max_episode_ticks = max_episode_ticks;
+  c.ai_opponent = ai_opponent;
+  Vec_Env *e = malloc(sizeof(Vec_Env));
+  if (!e)
+    return NULL;
+  if (!vec_env_init(e, env_cnt, &c)) {
+    free(e);
+    return NULL;
+  }
+  return e;
+}
+
+void vec_env_destroy(Vec_Env *e) {
+  if (!e)
+    return;
+  vec_env_free(e);
+  free(e);
+}
+
+Pong_Observation *vec_env_obs(Vec_Env *e) { return e->obs; }
+
+Pong_Observation *vec_env_final_obs(Vec_Env *e) { return e->final_obs; }
+
+float *vec_env_rewards(Vec_Env *e) { return e->rewards; }
+
+uint8_t *vec_env_dones(Vec_Env *e) { return e->dones; }
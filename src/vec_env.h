@@ -0,0 +1,75 @@
+#ifndef PONG_VEC_ENV_H
+#define PONG_VEC_ENV_H
+
+// Vectorized, gym-style environment for training agents. An agent plays the
+// right paddle of every environment; the left one is an Ai_Controller or
+// stands still. One episode is one point: when it ends the environment
+// serves the next point on its own (auto-reset), and obs already holds the
+// first observation of the new episode while final_obs keeps the last one of
+// the old.
+//
+// All per-environment buffers are allocated once in vec_env_init, 64-byte
+// aligned and contiguous, and are rewritten in place by every reset/step,
+// so a trainer can wrap them once (say with numpy.frombuffer) and read them
+// without copies. obs rows are Pong_Observation from policy_abi.h.
+//
+// env.sh builds this into libpong_env.so. Through a C FFI, use the
+// vec_env_create family below: the handle is opaque, so a trainer only
+// mirrors Pong_Observation and never the layout of Vec_Env.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ai.h"
+#include "policy_abi.h"
+#include "sim.h"
+
+typedef enum {
+  Env_Done_None,
+  Env_Done_Point,     // someone scored, see the reward
+  Env_Done_Truncated, // max_episode_ticks ran out
+} Env_Done;
+
+typedef struct {
+  int ticks_per_step;         // actions repeat for this many ticks
+  uint64_t max_episode_ticks; // 0 for no limit
+  bool ai_opponent;           // false leaves the left paddle still
+  Ai_Config opponent;
+} Vec_Env_Config;
+
+typedef struct {
+  int env_cnt;
+  Vec_Env_Config config;
+  State *states;
+  Ai_Controller *opponents;
+  uint64_t *episode_ticks;
+  // Outputs, env_cnt entries each.
+  Pong_Observation *obs;
+  Pong_Observation *final_obs; // valid where dones[i] != Env_Done_None
+  float *rewards;              // +1 agent scored, -1 opponent scored
+  uint8_t *dones;              // Env_Done
+} Vec_Env;
+
+void init_vec_env_config(Vec_Env_Config *c);
+// Returns false on allocation failure.
+bool vec_env_init(Vec_Env *e, int env_cnt, const Vec_Env_Config *c);
+void vec_env_free(Vec_Env *e);
+
+// Starts a fresh match in every environment from seeds[i] and fills obs.
+void vec_env_reset(Vec_Env *e, const uint64_t *seeds);
+// actions[i] is a Pong_Action for environment i. Fills obs, rewards, dones
+// and, for finished episodes, final_obs.
+void vec_env_step(Vec_Env *e, const uint8_t *actions);
+
+// Shared-library entry points. vec_env_create returns NULL on allocation
+// failure; the other settings are init_vec_env_config's defaults. The
+// buffers stay at the same address until vec_env_destroy.
+Vec_Env *vec_env_create(int env_cnt, int ticks_per_step,
+                        uint64_t max_episode_ticks, bool ai_opponent);
+void vec_env_destroy(Vec_Env *e);
+Pong_Observation *vec_env_obs(Vec_Env *e);
+Pong_Observation *vec_env_final_obs(Vec_Env *e);
+float *vec_env_rewards(Vec_Env *e);
+uint8_t *vec_env_dones(Vec_Env *e);
+
+#endif